@@ -33,6 +33,11 @@ class Bezierpredict{
         double history_time_init;
         //0.1秒，分为100段
         vector<double> time_each_seg;
+
+        // solve in closed form when no velocity/acceleration bound is active, OOQP otherwise
+        bool fast_path_;
+        // problem sizes are fixed, so the OOQP problem formulation is built once
+        QpGenSparseMa27 *qp_;
     public:
 
 
@@ -46,6 +51,8 @@ class Bezierpredict{
         return factorial(n) / (factorial(k) * factorial(n - k));}
       Bezierpredict(){
         traj_order = 5;            
+        fast_path_ = true;
+        qp_ = NULL;
         M = Eigen::MatrixXd::Zero(6,6);
         M << 1,   0,   0,   0,  0,  0,
             -5,   5,   0,   0,  0,  0,
@@ -61,7 +68,9 @@ class Bezierpredict{
         }    
         }
 
-        ~Bezierpredict(){}
+        ~Bezierpredict(){ delete qp_; }
+
+        void setFastPath(bool fast_path){ fast_path_ = fast_path; }
 
 
         int TrackingGeneration(
@@ -2,6 +2,7 @@
 #define _PREDICTOR_H_
 
 #include "bezier_predict.h"
+#include "rls_predict.h"
 #include <list>
 #include <plan_env/grid_map.h>
 #include <traj_utils/planning_visualization.h>
@@ -42,6 +43,12 @@ namespace ego_planner
     int count_;
     int freq_donw_;
     Bezierpredict bezierpredict_;
+    RlsPredict rls_predict_;
+    enum PREDICT_BACKEND
+    {
+      BEZIER_QP = 0,
+      RECURSIVE_LS = 1
+    } predict_backend_;
     PlanningVisualization::Ptr visualization_;
     ros::Time start_time_;
 
@@ -50,6 +57,7 @@ namespace ego_planner
     double max_dis_;
     double min_dis_;
     
+    void addTargetSample(const Eigen::Vector4d &odom_pos);
     void odometryCallback(const nav_msgs::OdometryConstPtr &msg);
     void RealworldTargetOdometryCallback(const nav_msgs::OdometryConstPtr &msg);
     void SimulatorTargetOdometryCallback(const nav_msgs::OdometryConstPtr &msg);
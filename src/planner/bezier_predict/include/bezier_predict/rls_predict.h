@@ -0,0 +1,131 @@
+#ifndef _RLS_PREDICT_H_
+#define _RLS_PREDICT_H_
+
+#include <Eigen/Eigen>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+using std::vector;
+
+// Recursive least squares fit of p(tau) = c_0 + c_1 tau + ... + c_n tau^n (n = 1: constant velocity,
+// n = 2: constant acceleration) to the target positions, tau is the time since the newest sample.
+// Older samples are discounted by the forgetting factor and, with a window, the sample leaving it is
+// downdated, so each sample costs O(n^2) and nothing is refitted. The window keeps the fit local:
+// exponential forgetting alone leaves a long tail of old samples that biases the fit on curved paths.
+class RlsPredict
+{
+private:
+  int order_;
+  double forgetting_;
+  int window_;            // samples kept in the fit, <= 0 keeps all of them
+  double init_cov_;
+  Eigen::MatrixXd coeff_; // (order_+1) x 3, row k is c_k
+  Eigen::MatrixXd P_;     // covariance of the coefficients, shared by x, y and z
+  std::deque<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>> samples_; // position and time in the window
+  double t_last_;
+  int sample_num_;
+
+  // remove the sample at tau that has been discounted to weight w
+  void downdate(const Eigen::Vector3d &pos, double tau, double w)
+  {
+    Eigen::VectorXd h(order_ + 1);
+    h(0) = 1.0;
+    for (int k = 1; k <= order_; ++k)
+      h(k) = h(k - 1) * tau;
+
+    Eigen::VectorXd Ph = P_ * h;
+    P_ += w * Ph * Ph.transpose() / (1.0 - w * h.dot(Ph));
+    Eigen::RowVector3d err = pos.transpose() - h.transpose() * coeff_;
+    coeff_ -= w * (P_ * h) * err;
+  }
+
+public:
+  RlsPredict(int order = 1, double forgetting = 0.95, int window = 8) : init_cov_(1e4)
+  {
+    reset(order, forgetting, window);
+  }
+
+  void reset(int order, double forgetting, int window)
+  {
+    order_ = std::max(1, std::min(order, 2));
+    forgetting_ = forgetting;
+    window_ = window > 0 ? std::max(window, order_ + 2) : 0;
+    coeff_ = Eigen::MatrixXd::Zero(order_ + 1, 3);
+    P_ = init_cov_ * Eigen::MatrixXd::Identity(order_ + 1, order_ + 1);
+    samples_.clear();
+    t_last_ = 0.0;
+    sample_num_ = 0;
+  }
+
+  int getSampleNum() const { return sample_num_; }
+
+  void addSample(const Eigen::Vector3d &pos, double t)
+  {
+    if (sample_num_ == 0)
+    {
+      // weak prior, the first sample then enters like any other so that it can be downdated later
+      coeff_.setZero();
+      P_ = init_cov_ * Eigen::MatrixXd::Identity(order_ + 1, order_ + 1);
+    }
+    else
+    {
+      // move the origin of tau to the new sample, p(tau + dt) written as a polynomial in tau
+      double dt = t - t_last_;
+      Eigen::MatrixXd T = Eigen::MatrixXd::Identity(order_ + 1, order_ + 1);
+      T(0, 1) = dt;
+      if (order_ == 2)
+      {
+        T(0, 2) = dt * dt;
+        T(1, 2) = 2 * dt;
+      }
+      coeff_ = T * coeff_;
+      P_ = T * P_ * T.transpose() / forgetting_;
+    }
+
+    // the regressor of the new sample is (1, 0, 0) since tau = 0
+    Eigen::VectorXd K = P_.col(0) / (1.0 + P_(0, 0));
+    Eigen::RowVector3d err = pos.transpose() - coeff_.row(0);
+    coeff_ += K * err;
+    P_ -= K * P_.row(0);
+
+    t_last_ = t;
+    sample_num_++;
+
+    if (window_ > 0)
+    {
+      samples_.push_back(Eigen::Vector4d(pos(0), pos(1), pos(2), t));
+      if ((int)samples_.size() > window_)
+      {
+        // the oldest sample has been discounted once per newer sample
+        const Eigen::Vector4d &old = samples_.front();
+        downdate(old.head(3), old(3) - t, std::pow(forgetting_, window_));
+        samples_.pop_front();
+      }
+    }
+  }
+
+  // positions from the newest sample on, every dt for duration, with the fitted velocity
+  // and acceleration saturated per axis
+  vector<Eigen::Vector3d> samplePosList(double duration, double dt, double max_vel, double max_acc) const
+  {
+    vector<Eigen::Vector3d> pos_list;
+    Eigen::Vector3d p = coeff_.row(0).transpose();
+    Eigen::Vector3d v = coeff_.row(1).transpose().cwiseMax(-max_vel).cwiseMin(max_vel);
+    Eigen::Vector3d a = Eigen::Vector3d::Zero();
+    if (order_ == 2)
+      a = (2 * coeff_.row(2).transpose()).cwiseMax(-max_acc).cwiseMin(max_acc);
+
+    for (double t = 0; t < duration; t += dt)
+    {
+      pos_list.push_back(p);
+      Eigen::Vector3d v_next = (v + a * dt).cwiseMax(-max_vel).cwiseMin(max_vel);
+      p += 0.5 * (v + v_next) * dt;
+      v = v_next;
+    }
+    return pos_list;
+  }
+};
+
+#endif
@@ -20,7 +20,7 @@ MatrixXd Bezierpredict::getQ(const int vars_number, const vector<double> Time, c
         {
             if (i - d_order >= 0 && j - d_order >= 0)
             { 
-                Q_k(i, j) = (factorial(i) / factorial(i - d_order)) * ((factorial(j) / factorial(j - d_order))) /
+                Q_k(i, j) = (factorial(i) / factorial(i - d_order)) * ((factorial(j) / factorial(j - d_order))) / (double)
                             (i + j - 2 * d_order + 1) * pow(Time[seg_index], (i + j - 2 * d_order + 1)); // Q of one segment
             }
         }
@@ -299,6 +299,42 @@ int Bezierpredict::TrackingGeneration(
                     }
         sub_shift += all_vars_number;
     }
+    // 无约束快速通道: x, y, z 共用 M_QM 的同一个 6x6 块和 end_p 约束行, 只有等式约束时有闭式解.
+    // 若闭式解同时满足速度/加速度约束, 它就是原问题的最优解, 不必再调用 OOQP.
+    // 闭式解只处理单段; 多段时段间的连续性约束不在 dA 中, 交给 OOQP.
+    if(fast_path_ && !constrain_flag && segs == 1){
+        MatrixXd H = M_QM.block(0, 0, vars_number, vars_number);
+        LDLT<MatrixXd> H_ldlt(H);
+        VectorXd a = Map<VectorXd>(dA, vars_number);
+        VectorXd Ha = H_ldlt.solve(a);
+        double aHa = a.dot(Ha);
+
+        if(H_ldlt.info() == Success && H_ldlt.isPositive() && aHa > 0){
+            // min 0.5 x'Hx + c'x  s.t. a'x = b  ->  x = H^-1 (lambda * a - c)
+            MatrixXd x(vars_number, 3);
+            for(int i = 0; i < 3; i++){
+                VectorXd Hc = H_ldlt.solve(Map<VectorXd>(c + i * vars_number, vars_number));
+                double lambda = (b[i] + a.dot(Hc)) / aHa;
+                x.col(i) = lambda * Ha - Hc;
+            }
+
+            VectorXd Cx = VectorXd::Zero(mz);
+            for(int i = 0; i < nnzC; i++)
+                Cx(irowC[i]) += dC[i] * x(jcolC[i]);
+
+            bool feasible = true;
+            for(int i = 0; i < mz && feasible; i++)
+                feasible = Cx(i) >= clow[i] - 1e-9 && Cx(i) <= cupp[i] + 1e-9;
+
+            if(feasible){
+                PolyCoeff = Map<MatrixXd>(x.data(), segs, all_vars_number);
+                PolyTime  = VectorXd::Constant(segs, total_time_intervals[0]);
+                obj = 0.0;
+                return 0;
+            }
+        }
+    }
+
     // 下面开始OOQP库的求解
     //my=0;
     //nnzA=0;
@@ -334,8 +370,9 @@ int Bezierpredict::TrackingGeneration(
         s     = new GondzioSolver( qp, prob );
     }
     else{
-        qp 
-        = new QpGenSparseMa27( nx, my, mz, nnzQ, nnzA, nnzC );
+        if(qp_ == NULL)
+            qp_ = new QpGenSparseMa27( nx, my, mz, nnzQ, nnzA, nnzC );
+        qp = qp_;
         //cout<<"irowQ: "<<irowQ[nnzQ-1]<<"jcolQ: "<<jcolQ[nnzQ-1];
         //cout<<"nx: "<<nx<<" my: "<<my<<" mz: "<<mz<<" nnzQ: "<<nnzQ<<" nnzA: "<<nnzA<<" nnzC: "<<nnzC<<" size: "<<M_QM.cols()<<" "<<M_QM.rows();
         prob = (QpGenData * ) qp->copyDataFromSparseTriple(
@@ -414,6 +451,13 @@ int Bezierpredict::TrackingGeneration(
         ROS_ERROR("Front Bezier Predict: The program is very slow in convergence, may have numerical issue");
     else
         ROS_ERROR("Front Bezier Predict: Solver numerical error");
+
+    delete s;
+    delete resid;
+    delete vars;
+    delete prob;
+    if(qp != qp_)
+        delete qp;
     
     ros::Time time_2 = ros::Time::now();
     // ROS_INFO_STREAM("Bezier time consumed:" << (time_2 - time_1).toSec()*1000<<" ms");
@@ -28,6 +28,18 @@ namespace ego_planner
     nh.param("bezier_predict/simulation_fov_max_dist", max_dis_, -1.0);
     nh.param("bezier_predict/simulation_fov_min_dist", min_dis_, -1.0);
     nh.param("bezier_predict/freq_donw", freq_donw_, -1);
+    bool qp_fast_path;
+    nh.param("bezier_predict/qp_fast_path", qp_fast_path, true);
+    bezierpredict_.setFastPath(qp_fast_path);
+
+    int backend, rls_order, rls_window;
+    double rls_forgetting;
+    nh.param("bezier_predict/backend", backend, 0);
+    nh.param("bezier_predict/rls_order", rls_order, 1);
+    nh.param("bezier_predict/rls_forgetting", rls_forgetting, 0.95);
+    nh.param("bezier_predict/rls_window", rls_window, 8);
+    predict_backend_ = backend == 1 ? RECURSIVE_LS : BEZIER_QP;
+    rls_predict_.reset(rls_order, rls_forgetting, rls_window);
 
     if(simulation_flag)
       target_odom_sub_ = nh.subscribe("simulator_target_odom", 1, &Predictor::SimulatorTargetOdometryCallback, this, ros::TransportHints().tcpNoDelay());
@@ -68,6 +80,16 @@ namespace ego_planner
     have_odom_ = true;
   }
 
+  void Predictor::addTargetSample(const Eigen::Vector4d &odom_pos)
+  {
+    target_list_.push_back(odom_pos);
+
+    if( target_list_.size() > list_max_size_ )
+      target_list_.erase(target_list_.begin());
+
+    rls_predict_.addSample(odom_pos.head(3), odom_pos(3));
+  }
+
   void Predictor::RealworldTargetOdometryCallback(const nav_msgs::OdometryConstPtr &msg)
   {
     if( !have_odom_ )
@@ -83,10 +105,7 @@ namespace ego_planner
     Eigen::Vector3d swarm_prid = odom_pos.block(0,0,3,1);
     Eigen::Vector3d dist_vec = swarm_prid - drone_pos;
 
-    target_list_.push_back(odom_pos);
-
-    if( target_list_.size() > list_max_size_ )
-      target_list_.erase(target_list_.begin());
+    addTargetSample(odom_pos);
 
     updateAndVisualPredict();
   }
@@ -104,7 +123,7 @@ namespace ego_planner
       odom_pos(1) = msg->pose.pose.position.y;
       odom_pos(2) = msg->pose.pose.position.z;
       odom_pos(3) = ros::Time::now().toSec();
-      target_list_.push_back(odom_pos);
+      addTargetSample(odom_pos);
       return;
     }
   
@@ -163,10 +182,7 @@ namespace ego_planner
         {
           // std::cout << "tracking!!!" << std::endl;
 
-          target_list_.push_back(odom_pos);
-
-          if( target_list_.size() > list_max_size_ )
-            target_list_.erase(target_list_.begin());
+          addTargetSample(odom_pos);
 
           updateAndVisualPredict();
         }
@@ -180,6 +196,14 @@ namespace ego_planner
     if( target_list_.size() < 15 )
       return false;
 
+    if( predict_backend_ == RECURSIVE_LS )
+    {
+      // same sampling as SamplePoslist_bezier(_PREDICT_SEG) and the same limits as the QP
+      std::vector<Eigen::Vector3d> sample_pos = rls_predict_.samplePosList(_TIME_INTERVAL * _PREDICT_SEG, SAMPLE_INTERVALS, 5, 5);
+      sample_list.insert( sample_list.end(), sample_pos.begin(), sample_pos.end() );
+      return true;
+    }
+
     int bezier_flag = bezierpredict_.TrackingGeneration(5,5,target_list_);
     if( bezier_flag == 0 )
     {
@@ -215,7 +239,8 @@ namespace ego_planner
       start_end_derivatives.push_back(Eigen::Vector3d::Zero());
       start_end_derivatives.push_back(Eigen::Vector3d::Zero());
       start_end_derivatives.push_back(Eigen::Vector3d::Zero());
-      UniformBspline::parameterizeToBspline(ts, sample_list_, start_end_derivatives, ctrl_pts);
+      if( !UniformBspline::parameterizeToBspline(ts, sample_list_, start_end_derivatives, ctrl_pts) )
+        return;
 
       UniformBspline pos_traj(ctrl_pts, 3, ts);
       double duration = sample_list_.size() * ts;
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <bezier_predict/bezier_predict.h>
+
+#include <cmath>
+
+namespace
+{
+
+// integral over [0, T] of the product of the second derivatives of t^i and t^j, composite Simpson
+double accelerationIntegral(int i, int j, double T)
+{
+  auto acc = [](int k, double t) { return k < 2 ? 0.0 : k * (k - 1) * std::pow(t, k - 2); };
+  const int n = 2000;
+  const double h = T / n;
+  double sum = 0.0;
+  for (int s = 0; s <= n; ++s)
+  {
+    double w = (s == 0 || s == n) ? 1.0 : (s % 2 ? 4.0 : 2.0);
+    sum += w * acc(i, s * h) * acc(j, s * h);
+  }
+  return sum * h / 3.0;
+}
+
+}  // namespace
+
+// getQ is the cost matrix of the predictor QP, the closed-form path needs it to be the exact integral
+TEST(BezierpredictTest, CostMatrixIsAccelerationIntegral)
+{
+  Bezierpredict predictor;
+  const int vars_number = 6;
+
+  for (double T : {0.5, 1.0, 1.5})
+  {
+    std::vector<double> time(1, T);
+    Eigen::MatrixXd Q = predictor.getQ(vars_number, time, 0);
+    ASSERT_EQ(Q.rows(), vars_number);
+    ASSERT_EQ(Q.cols(), vars_number);
+
+    for (int i = 0; i < vars_number; ++i)
+      for (int j = 0; j < vars_number; ++j)
+      {
+        double expected = accelerationIntegral(i, j, T);
+        EXPECT_NEAR(Q(i, j), expected, 1e-9 * std::max(1.0, std::abs(expected)))
+            << "Q(" << i << ", " << j << ") for T = " << T;
+      }
+
+    // the acceleration cost is positive definite on the coefficients of t^2 .. t^5
+    Eigen::LLT<Eigen::MatrixXd> llt(Q.bottomRightCorner(vars_number - 2, vars_number - 2));
+    EXPECT_EQ(llt.info(), Eigen::Success) << "T = " << T;
+  }
+
+  // 4 * 3 * 4 * 3 / 5, integer division used to give 28
+  std::vector<double> unit_time(1, 1.0);
+  EXPECT_DOUBLE_EQ(predictor.getQ(vars_number, unit_time, 0)(4, 4), 28.8);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
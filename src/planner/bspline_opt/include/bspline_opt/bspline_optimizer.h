@@ -83,13 +83,56 @@ namespace ego_planner
     }
   };
 
+  // Read-only part of an optimization problem: environment, weights, limits and targets.
+  // Optimizers share it, so several of them can solve on the same map at once; the setters
+  // of BsplineOptimizer install a modified copy instead of writing into the shared one.
+  struct BsplineProblem
+  {
+    GridMap::Ptr grid_map_;
+    fast_planner::ObjPredictor::Ptr moving_objs_;
+    SwarmTrajData *swarm_trajs_{NULL}; // Can not use shared_ptr and no need to free
+    int drone_id_{-1};
+
+    int order_{3};                 // bspline degree
+    double lambda1_;               // jerk smoothness weight
+    double lambda2_;               // distance weight
+    double lambda3_;               // feasibility weight
+    double lambda4_;               // curve fitting
+
+    double tracking_lambda_visibility_;
+    double tracking_lambda_smooth_;
+    double tracking_lambda_esdf_;
+    double tracking_lambda_feasibility_;
+    double tracking_lambda_tracking_dist_;
+    double tracking_lambda_smoothness_yaw_;
+    double tracking_lambda_feasibility_yaw_;
+    double tracking_lambda_tracking_yaw_and_pos_;
+    double tracking_lambda_safe_yaw_;
+
+    double dist0_, swarm_clearance_; // safe distance
+    double max_vel_, max_acc_;       // dynamic limits
+    bool warm_start_{false};         // reuse the L-BFGS memory of the last rebound solve
+
+    double best_attract_max_dist_, best_attract_min_dist_, attract_max_dist_threshold_, attract_min_dist_threshold_;
+
+    Eigen::Vector3d local_target_pt_;
+    double init_yaw_, init_yaw_sin_, init_yaw_cos_, target_vel_yaw_;
+
+    typedef std::shared_ptr<const BsplineProblem> ConstPtr;
+  };
+
   class BsplineOptimizer
   {
 
   public:
-    BsplineOptimizer() {}
+    BsplineOptimizer() : problem_(new BsplineProblem) {}
+    explicit BsplineOptimizer(const BsplineProblem::ConstPtr &problem) : problem_(problem) {}
     ~BsplineOptimizer() {}
 
+    // share the problem of another optimizer, the workspace of this one is kept
+    const BsplineProblem::ConstPtr &getProblem() const { return problem_; }
+    void setProblem(const BsplineProblem::ConstPtr &problem) { problem_ = problem; }
+
     /* main API */
     void setEnvironment(const GridMap::Ptr &map);
     void setEnvironment(const GridMap::Ptr &map, const fast_planner::ObjPredictor::Ptr mov_obj);
@@ -112,7 +155,14 @@ namespace ego_planner
     void setGuidePath(const vector<Eigen::Vector3d> &guide_pt);
     void setWaypoints(const vector<Eigen::Vector3d> &waypts,
                       const vector<int> &waypt_idx); // N-2 constraints at most
-    void setLocalTargetPt(const Eigen::Vector3d local_target_pt) { local_target_pt_ = local_target_pt; };
+    void setLocalTargetPt(const Eigen::Vector3d local_target_pt) { editProblem().local_target_pt_ = local_target_pt; };
+    // rebound solves give up once their cost exceeds ratio times the reference cost after as many
+    // iterations, the last reference cost applies beyond its end; NULL disables the bound
+    void setCostBound(const std::vector<double> *reference_costs, double ratio) { cost_bound_ = reference_costs; cost_bound_ratio_ = ratio; };
+    // cost after every iteration of the last rebound solve
+    const std::vector<double> &getCostHistory() const { return cost_history_; }
+    // forget the last solve, the next rebound solve starts cold
+    void clearWarmStart() { warm_memory_.count = 0; warm_points_.resize(3, 0); };
 
     void optimize();
 
@@ -127,8 +177,18 @@ namespace ego_planner
     bool BsplineOptimizeTrajRebound(Eigen::MatrixXd &optimal_points, double &final_cost, const ControlPoints &control_points, double ts);
     bool BsplineOptimizeTrajRefine(const Eigen::MatrixXd &init_points, const double ts, Eigen::MatrixXd &optimal_points);
 
-    inline int getOrder(void) { return order_; }
-    inline double getSwarmClearance(void) { return swarm_clearance_; }
+    // Rebound solves of the distinctive candidates. optimizers[k] runs on pool thread k, or optimizers[0]
+    // solves all of them if pool is NULL; the optimizers must share one problem. The first candidate (the
+    // original rebound directions) is solved first, the others give up once their cost exceeds cost_ratio
+    // times its cost after the same number of iterations (0 disables). That bound is fixed before the
+    // others start, so the results do not depend on the number of threads.
+    static void optimizeCandidates(const std::vector<BsplineOptimizer *> &optimizers, ThreadPool *pool,
+                                   const std::vector<ControlPoints> &trajs, double ts, double cost_ratio,
+                                   std::vector<Eigen::MatrixXd> &optimal_points, std::vector<double> &final_costs,
+                                   std::vector<char> &success);
+
+    inline int getOrder(void) { return problem_->order_; }
+    inline double getSwarmClearance(void) { return problem_->swarm_clearance_; }
     inline double getBsplineInterval(void) {return bspline_interval_;}
 
 
@@ -146,11 +206,10 @@ namespace ego_planner
     vector<Eigen::Vector3d> vis_pk, vis_pk_grad, vis_pk_grad_real;
 
   private:
-    GridMap::Ptr grid_map_;
-    fast_planner::ObjPredictor::Ptr moving_objs_;
-    SwarmTrajData *swarm_trajs_{NULL}; // Can not use shared_ptr and no need to free
-    int drone_id_;
+    BsplineProblem::ConstPtr problem_;
+    BsplineProblem &editProblem();
 
+    /* everything below is the workspace of one solve */
     enum FORCE_STOP_OPTIMIZE_TYPE
     {
       DONT_STOP,
@@ -158,6 +217,11 @@ namespace ego_planner
       STOP_FOR_ERROR
     } force_stop_type_;
 
+    const std::vector<double> *cost_bound_{NULL}; // costs of the first candidate, see optimizeCandidates()
+    double cost_bound_ratio_{2.0};
+    std::vector<double> cost_history_;
+    bool flag_cost_bound_stop_{false};
+
     // main input
     // Eigen::MatrixXd control_points_;     // B-spline control points, N x dim
     double bspline_interval_; // B-spline knot span
@@ -172,28 +236,8 @@ namespace ego_planner
     int cost_function_;                 // used to determine objective function
     double start_time_;                 // global time for moving obstacles
 
-    /* optimization parameters */
-    int order_;                    // bspline degree
-    double lambda1_;               // jerk smoothness weight
-    double lambda2_, new_lambda2_; // distance weight
-    double lambda3_;               // feasibility weight
-    double lambda4_;               // curve fitting
-
-    double tracking_lambda_visibility_;
-    double tracking_lambda_smooth_;
-    double tracking_lambda_esdf_;
-    double tracking_lambda_feasibility_;
-    double tracking_lambda_tracking_dist_;
-    double tracking_lambda_smoothness_yaw_;
-    double tracking_lambda_feasibility_yaw_;
-    double tracking_lambda_tracking_yaw_and_pos_;
-    double tracking_lambda_safe_yaw_;
-
-
-    int a;
-    //
-    double dist0_, swarm_clearance_; // safe distance
-    double max_vel_, max_acc_;       // dynamic limits
+    double new_lambda2_; // distance weight, raised while the swarm is too close
+    double new_lambda4_; // curve fitting weight, raised while the refined traj collides
 
     int variable_num_;              // optimization variables
     int iter_num_;                  // iteration of the solver
@@ -202,13 +246,29 @@ namespace ego_planner
     Eigen::VectorXd best_variable_; //
     double min_cost_;               //
 
-    Eigen::Vector3d local_target_pt_; 
+    // warm start of rebound_optimize(): optimum and L-BFGS memory of the last successful solve
+    lbfgs::lbfgs_memory_t warm_memory_;
+    Eigen::MatrixXd warm_points_;
+    double warm_interval_{0.0};
+    int solve_count_{0}, warm_count_{0};
+    long iter_count_{0}, warm_iter_count_{0};
 
 #define INIT_min_ellip_dist_ 123456789.0123456789
     double min_ellip_dist_;
 
     ControlPoints cps_, cps_yaw_;
     vector<double> waypoints_yaw_; // waypts constraints
+
+    // reused by the batched esdf queries of the cost functions
+    Eigen::Matrix3Xd esdf_batch_pts_, esdf_batch_grad_;
+    Eigen::VectorXd esdf_batch_dist_;
+    Eigen::VectorXi esdf_batch_valid_;
+
+    // gradients of the cost terms, resized once and reused by every cost evaluation
+    Eigen::MatrixXd g_smoothness_, g_distance_, g_feasibility_, g_fitness_, g_swarm_, g_swarm_attract_, g_terminal_;
+    Eigen::MatrixXd g_esdf_, g_tracking_dist_, g_visibility_, g_tracking_pos_;
+    Eigen::MatrixXd g_smoothness_yaw_, g_feasibility_yaw_, g_safe_yaw_, g_tracking_yaw_;
+    Eigen::MatrixXd grad_3D_, grad_yaw_;
     vector<int> waypt_idx_yaw_;             // waypts constraints index
 
     /* cost function */
@@ -236,6 +296,7 @@ namespace ego_planner
     static double costFunctionRefine(void *func_data, const double *x, double *grad, const int n);
 
     bool rebound_optimize(double &final_cost);
+    bool prepareWarmStart(int start_id);
     bool refine_optimize();
     void combineCostRebound(const double *x, double *grad, double &f_combine, const int n);
     void combineCostRefine(const double *x, double *grad, double &f_combine, const int n);
@@ -260,16 +321,12 @@ namespace ego_planner
                                    double &cost, 
                                    Eigen::MatrixXd &gradient_yaw, Eigen::MatrixXd &gradient_pos);
     
-    double init_yaw_, init_yaw_sin_, init_yaw_cos_, target_vel_yaw_;
- 
     vector<int> attract_pts_;             
     vector<Eigen::Vector3d> attract_pts_cor_drone_;             
     vector<double> attract_pts_best_yaw_;             
 
     bool if_equal( double x, double y );
 
-    double best_attract_max_dist_, best_attract_min_dist_, attract_max_dist_threshold_, attract_min_dist_threshold_;
-
 
     /* for benckmark evaluation only */
   public:
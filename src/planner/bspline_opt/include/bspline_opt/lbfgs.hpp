@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#include <vector>
 
 namespace lbfgs
 {
@@ -190,6 +191,21 @@ namespace lbfgs
         double xtol;
     };
 
+    /**
+     * Corrections carried from one lbfgs_optimize() call to the next (warm start).
+     *  Each call that receives this structure stores its latest corrections here,
+     *  and a later call with the same number of variables starts from them instead
+     *  of the identity hessian. Set count to zero to start cold.
+     */
+    struct lbfgs_memory_t
+    {
+        int n = 0;            /* number of variables the corrections belong to */
+        int count = 0;        /* number of stored corrections, oldest first */
+        std::vector<double> s; /* [count * n] */
+        std::vector<double> y; /* [count * n] */
+        std::vector<double> ys; /* [count] */
+    };
+
     /**
      * Callback interface to provide objective function and gradient evaluations.
      *
@@ -966,6 +982,92 @@ namespace lbfgs
         memcpy(param, &_default_param, sizeof(*param));
     }
 
+    /**
+     * Re-index stored corrections for a problem whose variable i was variable
+     * i + offset of the old one, with n variables. Entries without a counterpart
+     * are zero, and corrections left without positive curvature are dropped.
+     */
+    inline void lbfgs_memory_shift(lbfgs_memory_t *memory, int offset, int n)
+    {
+        int kept = 0;
+        std::vector<double> s(memory->count * n, 0.), y(memory->count * n, 0.), ys;
+
+        for (int i = 0; i < memory->count; ++i)
+        {
+            double *si = &s[kept * n], *yi = &y[kept * n];
+            for (int j = 0; j < n; ++j)
+            {
+                int old_j = j + offset;
+                if (old_j < 0 || old_j >= memory->n)
+                    continue;
+                si[j] = memory->s[i * memory->n + old_j];
+                yi[j] = memory->y[i * memory->n + old_j];
+            }
+
+            double sy, ss, yy;
+            vecdot(&sy, si, yi, n);
+            vecdot(&ss, si, si, n);
+            vecdot(&yy, yi, yi, n);
+            if (sy > 1e-10 * sqrt(ss * yy) && sy > 0.)
+            {
+                ys.push_back(sy);
+                ++kept;
+            }
+        }
+
+        s.resize(kept * n);
+        y.resize(kept * n);
+        memory->n = n;
+        memory->count = kept;
+        memory->s.swap(s);
+        memory->y.swap(y);
+        memory->ys.swap(ys);
+    }
+
+    /*
+    Recursive formula to compute dir = -(H \cdot g) from the latest bound corrections,
+    the newest one is just before lm[end]. This is described in page 779 of:
+    Jorge Nocedal.
+    Updating Quasi-Newton Matrices with Limited Storage.
+    Mathematics of Computation, Vol. 35, No. 151,
+    pp. 773--782, 1980.
+    */
+    inline void lbfgs_direction(double *d, const double *g, iteration_data_t *lm,
+                                const int m, const int end, const int bound, const double scale, const int n)
+    {
+        int i, j;
+        double beta;
+        iteration_data_t *it;
+
+        /* Compute the negative of gradients. */
+        vecncpy(d, g, n);
+
+        j = end;
+        for (i = 0; i < bound; ++i)
+        {
+            j = (j + m - 1) % m; /* if (--j == -1) j = m-1; */
+            it = &lm[j];
+            /* \alpha_{j} = \rho_{j} s^{t}_{j} \cdot q_{k+1}. */
+            vecdot(&it->alpha, it->s, d, n);
+            it->alpha /= it->ys;
+            /* q_{i} = q_{i+1} - \alpha_{i} y_{i}. */
+            vecadd(d, it->y, -it->alpha, n);
+        }
+
+        vecscale(d, scale, n);
+
+        for (i = 0; i < bound; ++i)
+        {
+            it = &lm[j];
+            /* \beta_{j} = \rho_{j} y^t_{j} \cdot \gamm_{i}. */
+            vecdot(&beta, it->y, d, n);
+            beta /= it->ys;
+            /* \gamm_{i+1} = \gamm_{i} + (\alpha_{j} - \beta_{j}) s_{j}. */
+            vecadd(d, it->s, it->alpha - beta, n);
+            j = (j + 1) % m; /* if (++j == m) j = 0; */
+        }
+    }
+
     /**
      * Start a L-BFGS optimization.
      * A user must implement a function compatible with ::lbfgs_evaluate_t (evaluation
@@ -1017,6 +1119,8 @@ namespace lbfgs
      *                      parameter to NULL to use the default parameters.
      *                      Call lbfgs_load_default_parameters() function to 
      *                      fill a structure with the default values.
+     *  @param  memory      Corrections of an earlier call to start from, updated
+     *                      with the latest ones on return. NULL starts cold.
      *  @retval int         The status code. This function returns zero if the
      *                      minimization process terminates without an error. A
      *                      non-zero value indicates an error.
@@ -1028,10 +1132,11 @@ namespace lbfgs
                               lbfgs_stepbound_t proc_stepbound,
                               lbfgs_progress_t proc_progress,
                               void *instance,
-                              lbfgs_parameter_t *_param)
+                              lbfgs_parameter_t *_param,
+                              lbfgs_memory_t *memory = NULL)
     {
         int ret;
-        int i, j, k, ls, end, bound;
+        int i, j, k, ls, end, bound, pairs;
         double step;
         int loop;
         double step_min, step_max;
@@ -1045,7 +1150,7 @@ namespace lbfgs
         double *d = NULL, *pf = NULL;
         iteration_data_t *lm = NULL, *it = NULL;
         double ys, yy;
-        double xnorm, gnorm, beta;
+        double xnorm, gnorm;
         double fx = 0.;
         double rate = 0.;
 
@@ -1122,6 +1227,21 @@ namespace lbfgs
             it->y = (double *)vecalloc(n * sizeof(double));
         }
 
+        /* Load the corrections of an earlier call. */
+        pairs = 0;
+        if (memory != NULL && memory->n == n && memory->count > 0)
+        {
+            pairs = memory->count < m ? memory->count : m;
+            for (i = 0; i < pairs; ++i)
+            {
+                j = memory->count - pairs + i;
+                veccpy(lm[i].s, &memory->s[j * n], n);
+                veccpy(lm[i].y, &memory->y[j * n], n);
+                lm[i].ys = memory->ys[j];
+            }
+        }
+        end = pairs % m;
+
         /* Allocate an array for storing previous values of the objective function. */
         if (0 < param.past)
         {
@@ -1139,9 +1259,19 @@ namespace lbfgs
 
         /*
         Compute the direction;
-        we assume the initial hessian matrix H_0 as the identity matrix.
+        we assume the initial hessian matrix H_0 as the identity matrix,
+        unless corrections of an earlier call are available.
         */
-        vecncpy(d, g, n);
+        if (pairs > 0)
+        {
+            it = &lm[pairs - 1];
+            vecdot(&yy, it->y, it->y, n);
+            lbfgs_direction(d, g, lm, m, pairs % m, pairs, it->ys / yy, n);
+        }
+        else
+        {
+            vecncpy(d, g, n);
+        }
 
         /*
         Make sure that the initial variables are not a minimizer.
@@ -1158,12 +1288,14 @@ namespace lbfgs
         else
         {
             /* Compute the initial step:
-            step = 1.0 / sqrt(vecdot(d, d, n))
+            step = 1.0 / sqrt(vecdot(d, d, n)), or the quasi-Newton step when warm started
             */
-            vec2norminv(&step, d, n);
+            if (pairs > 0)
+                step = 1.0;
+            else
+                vec2norminv(&step, d, n);
 
             k = 1;
-            end = 0;
             loop = 1;
 
             while (loop == 1)
@@ -1275,45 +1407,12 @@ namespace lbfgs
                 vecdot(&yy, it->y, it->y, n);
                 it->ys = ys;
 
-                /*
-                Recursive formula to compute dir = -(H \cdot g).
-                This is described in page 779 of:
-                Jorge Nocedal.
-                Updating Quasi-Newton Matrices with Limited Storage.
-                Mathematics of Computation, Vol. 35, No. 151,
-                pp. 773--782, 1980.
-                */
-                bound = (m <= k) ? m : k;
+                pairs = (pairs < m) ? pairs + 1 : m;
+                bound = pairs;
                 ++k;
                 end = (end + 1) % m;
 
-                /* Compute the negative of gradients. */
-                vecncpy(d, g, n);
-
-                j = end;
-                for (i = 0; i < bound; ++i)
-                {
-                    j = (j + m - 1) % m; /* if (--j == -1) j = m-1; */
-                    it = &lm[j];
-                    /* \alpha_{j} = \rho_{j} s^{t}_{j} \cdot q_{k+1}. */
-                    vecdot(&it->alpha, it->s, d, n);
-                    it->alpha /= it->ys;
-                    /* q_{i} = q_{i+1} - \alpha_{i} y_{i}. */
-                    vecadd(d, it->y, -it->alpha, n);
-                }
-
-                vecscale(d, ys / yy, n);
-
-                for (i = 0; i < bound; ++i)
-                {
-                    it = &lm[j];
-                    /* \beta_{j} = \rho_{j} y^t_{j} \cdot \gamm_{i}. */
-                    vecdot(&beta, it->y, d, n);
-                    beta /= it->ys;
-                    /* \gamm_{i+1} = \gamm_{i} + (\alpha_{j} - \beta_{j}) s_{j}. */
-                    vecadd(d, it->s, it->alpha - beta, n);
-                    j = (j + 1) % m; /* if (++j == m) j = 0; */
-                }
+                lbfgs_direction(d, g, lm, m, end, bound, ys / yy, n);
 
                 /*
                 Now the search direction d is ready. We try step = 1 first.
@@ -1328,6 +1427,23 @@ namespace lbfgs
             *ptr_fx = fx;
         }
 
+        /* Keep the latest corrections, oldest first, for the next call. */
+        if (memory != NULL)
+        {
+            memory->n = n;
+            memory->count = pairs;
+            memory->s.resize(pairs * n);
+            memory->y.resize(pairs * n);
+            memory->ys.resize(pairs);
+            for (i = 0; i < pairs; ++i)
+            {
+                j = (end - pairs + i + m) % m;
+                veccpy(&memory->s[i * n], lm[j].s, n);
+                veccpy(&memory->y[i * n], lm[j].y, n);
+                memory->ys[i] = lm[j].ys;
+            }
+        }
+
         vecfree(pf);
 
         /* Free memory blocks used by this function. */
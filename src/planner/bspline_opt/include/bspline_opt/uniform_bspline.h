@@ -24,12 +24,20 @@ namespace ego_planner
     Eigen::VectorXd u_; // knots vector
     double interval_;   // knot span \delta t
 
+    bool uniform_knots_; // knot span can be computed directly instead of searched
+    double knot_span_;
+
+    void updateKnotSpan();
+    int findSpan(const double &ub);
+    template <int P, int D>
+    static Eigen::Matrix<double, D, 1> deBoorLocal(Eigen::Matrix<double, D, P + 1> &d, const double *u, const double &ub);
+
     Eigen::MatrixXd getDerivativeControlPoints();
 
     double limit_vel_, limit_acc_, limit_ratio_, feasibility_tolerance_; // physical limits and time adjustment ratio
 
   public:
-    UniformBspline() {}
+    UniformBspline() : uniform_knots_(false), knot_span_(0.0) {}
     UniformBspline(const Eigen::MatrixXd &points, const int &order, const double &interval);
     ~UniformBspline();
 
@@ -43,6 +51,7 @@ namespace ego_planner
     void setKnot(const Eigen::VectorXd &knot);
     Eigen::VectorXd getKnot();
     Eigen::MatrixXd getControlPoint();
+    inline int getOrder() { return p_; }
     double getInterval();
     bool getTimeSpan(double &um, double &um_p);
 
@@ -52,11 +61,24 @@ namespace ego_planner
     inline Eigen::VectorXd evaluateDeBoorT(const double &t) { return evaluateDeBoor(t + u_(p_)); } // use t \in [0, duration]
     UniformBspline getDerivative();
 
+    // allocation-free versions for a known degree P and dimension D, e.g. <3, 3> or <3, 1>
+    template <int P, int D>
+    Eigen::Matrix<double, D, 1> evaluateFixed(const double &u);
+    template <int P, int D>
+    inline Eigen::Matrix<double, D, 1> evaluateFixedT(const double &t) { return evaluateFixed<P, D>(t + u_(p_)); }
+    template <int P, int D>
+    void evaluateFixedT(const double &t, Eigen::Matrix<double, D, 1> &pos, Eigen::Matrix<double, D, 1> &vel,
+                        Eigen::Matrix<double, D, 1> &acc);
+    // n samples at t0, t0 + dt, ..., each output is D x n and only reallocated when n changes
+    template <int P, int D>
+    void sampleFixedT(const double &t0, const double &dt, const int &n, Eigen::Matrix<double, D, Eigen::Dynamic> &pos,
+                      Eigen::Matrix<double, D, Eigen::Dynamic> &vel, Eigen::Matrix<double, D, Eigen::Dynamic> &acc);
+
     // 3D B-spline interpolation of points in point_set, with boundary vel&acc
     // constraints
     // input : (K+2) points with boundary vel/acc; ts
-    // output: (K+6) control_pts
-    static void parameterizeToBspline(const double &ts, const vector<Eigen::Vector3d> &point_set,
+    // output: (K+6) control_pts, false and ctrl_pts untouched if the input is invalid or singular
+    static bool parameterizeToBspline(const double &ts, const vector<Eigen::Vector3d> &point_set,
                                       const vector<Eigen::Vector3d> &start_end_derivative,
                                       Eigen::MatrixXd &ctrl_pts);
 
@@ -76,5 +98,83 @@ namespace ego_planner
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
+
+  // de Boor's algorithm on the p+1 control points of one span, u points to the knot u_(k-p)
+  template <int P, int D>
+  inline Eigen::Matrix<double, D, 1> UniformBspline::deBoorLocal(Eigen::Matrix<double, D, P + 1> &d, const double *u, const double &ub)
+  {
+    for (int r = 1; r <= P; ++r)
+    {
+      for (int i = P; i >= r; --i)
+      {
+        double alpha = (ub - u[i]) / (u[i + 1 + P - r] - u[i]);
+        d.col(i) = (1 - alpha) * d.col(i - 1) + alpha * d.col(i);
+      }
+    }
+    return d.col(P);
+  }
+
+  template <int P, int D>
+  inline Eigen::Matrix<double, D, 1> UniformBspline::evaluateFixed(const double &u)
+  {
+    if (p_ != P)
+      return evaluateDeBoor(u);
+
+    double ub = min(max(u_(p_), u), u_(m_ - p_));
+    int k = findSpan(ub);
+    Eigen::Matrix<double, D, P + 1> d = control_points_.block<D, P + 1>(0, k - P);
+    return deBoorLocal<P, D>(d, u_.data() + k - P, ub);
+  }
+
+  template <int P, int D>
+  inline void UniformBspline::evaluateFixedT(const double &t, Eigen::Matrix<double, D, 1> &pos, Eigen::Matrix<double, D, 1> &vel,
+                                             Eigen::Matrix<double, D, 1> &acc)
+  {
+    static_assert(P >= 2, "acceleration of a B-spline needs degree >= 2");
+
+    if (p_ != P)
+    {
+      UniformBspline vel_traj = getDerivative();
+      pos = evaluateDeBoorT(t);
+      vel = vel_traj.evaluateDeBoorT(t);
+      acc = vel_traj.getDerivative().evaluateDeBoorT(t);
+      return;
+    }
+
+    double ub = min(max(u_(p_), t + u_(p_)), u_(m_ - p_));
+    int k = findSpan(ub);
+    const double *u = u_.data() + k - P;
+
+    // control points of the derivatives restricted to the same span, see getDerivativeControlPoints()
+    Eigen::Matrix<double, D, P + 1> d = control_points_.block<D, P + 1>(0, k - P);
+    Eigen::Matrix<double, D, P> dv;
+    for (int i = 0; i < P; ++i)
+      dv.col(i) = P * (d.col(i + 1) - d.col(i)) / (u[i + P + 1] - u[i + 1]);
+    Eigen::Matrix<double, D, P - 1> da;
+    for (int i = 0; i < P - 1; ++i)
+      da.col(i) = (P - 1) * (dv.col(i + 1) - dv.col(i)) / (u[i + P + 1] - u[i + 2]);
+
+    pos = deBoorLocal<P, D>(d, u, ub);
+    vel = deBoorLocal<P - 1, D>(dv, u + 1, ub);
+    acc = deBoorLocal<P - 2, D>(da, u + 2, ub);
+  }
+
+  template <int P, int D>
+  inline void UniformBspline::sampleFixedT(const double &t0, const double &dt, const int &n, Eigen::Matrix<double, D, Eigen::Dynamic> &pos,
+                                           Eigen::Matrix<double, D, Eigen::Dynamic> &vel, Eigen::Matrix<double, D, Eigen::Dynamic> &acc)
+  {
+    pos.resize(D, n);
+    vel.resize(D, n);
+    acc.resize(D, n);
+
+    Eigen::Matrix<double, D, 1> p, v, a;
+    for (int i = 0; i < n; ++i)
+    {
+      evaluateFixedT<P, D>(t0 + i * dt, p, v, a);
+      pos.col(i) = p;
+      vel.col(i) = v;
+      acc.col(i) = a;
+    }
+  }
 } // namespace ego_planner
 #endif
\ No newline at end of file
@@ -5,46 +5,58 @@
 namespace ego_planner
 {
 
+  BsplineProblem &BsplineOptimizer::editProblem()
+  {
+    // other optimizers may be solving with the current problem, so never write into it
+    std::shared_ptr<BsplineProblem> problem(new BsplineProblem(*problem_));
+    problem_ = problem;
+    return *problem;
+  }
+
   void BsplineOptimizer::setParam(ros::NodeHandle &nh)
   {
-    nh.param("optimization/lambda_smooth", lambda1_, -1.0);
-    nh.param("optimization/lambda_collision", lambda2_, -1.0);
-    nh.param("optimization/lambda_feasibility", lambda3_, -1.0);
-    nh.param("optimization/lambda_fitness", lambda4_, -1.0);
-
-    nh.param("optimization/dist0", dist0_, -1.0);
-    nh.param("optimization/swarm_clearance", swarm_clearance_, -1.0);
-    nh.param("optimization/max_vel", max_vel_, -1.0);
-    nh.param("optimization/max_acc", max_acc_, -1.0);
-
-    nh.param("optimization/order", order_, 3);
-
-    nh.param("optimization/best_attract_max_dist", best_attract_max_dist_, 3.5);
-    nh.param("optimization/best_attract_min_dist", best_attract_min_dist_, 2.0);
-    nh.param("optimization/attract_max_dist_threshold", attract_max_dist_threshold_, 6.0);
-    nh.param("optimization/attract_min_dist_threshold", attract_min_dist_threshold_, 1.0);
-
-    nh.param("optimization/tracking_lambda_visibility", tracking_lambda_visibility_, -1.0);
-    nh.param("optimization/tracking_lambda_smooth", tracking_lambda_smooth_, -1.0);
-    nh.param("optimization/tracking_lambda_esdf", tracking_lambda_esdf_, -1.0);
-    nh.param("optimization/tracking_lambda_feasibility", tracking_lambda_feasibility_, -1.0);
-    nh.param("optimization/tracking_lambda_tracking_dist", tracking_lambda_tracking_dist_, -1.0);
-    nh.param("optimization/tracking_lambda_smoothness_yaw", tracking_lambda_smoothness_yaw_, -1.0);
-    nh.param("optimization/tracking_lambda_feasibility_yaw", tracking_lambda_feasibility_yaw_, -1.0);
-    nh.param("optimization/tracking_lambda_tracking_yaw_and_pos", tracking_lambda_tracking_yaw_and_pos_, -1.0);
-    nh.param("optimization/tracking_lambda_safe_yaw", tracking_lambda_safe_yaw_, -1.0);
+    BsplineProblem &pb = editProblem();
+
+    nh.param("optimization/lambda_smooth", pb.lambda1_, -1.0);
+    nh.param("optimization/lambda_collision", pb.lambda2_, -1.0);
+    nh.param("optimization/lambda_feasibility", pb.lambda3_, -1.0);
+    nh.param("optimization/lambda_fitness", pb.lambda4_, -1.0);
+
+    nh.param("optimization/dist0", pb.dist0_, -1.0);
+    nh.param("optimization/swarm_clearance", pb.swarm_clearance_, -1.0);
+    nh.param("optimization/max_vel", pb.max_vel_, -1.0);
+    nh.param("optimization/max_acc", pb.max_acc_, -1.0);
+    nh.param("optimization/warm_start", pb.warm_start_, false);
+
+    nh.param("optimization/order", pb.order_, 3);
+
+    nh.param("optimization/best_attract_max_dist", pb.best_attract_max_dist_, 3.5);
+    nh.param("optimization/best_attract_min_dist", pb.best_attract_min_dist_, 2.0);
+    nh.param("optimization/attract_max_dist_threshold", pb.attract_max_dist_threshold_, 6.0);
+    nh.param("optimization/attract_min_dist_threshold", pb.attract_min_dist_threshold_, 1.0);
+
+    nh.param("optimization/tracking_lambda_visibility", pb.tracking_lambda_visibility_, -1.0);
+    nh.param("optimization/tracking_lambda_smooth", pb.tracking_lambda_smooth_, -1.0);
+    nh.param("optimization/tracking_lambda_esdf", pb.tracking_lambda_esdf_, -1.0);
+    nh.param("optimization/tracking_lambda_feasibility", pb.tracking_lambda_feasibility_, -1.0);
+    nh.param("optimization/tracking_lambda_tracking_dist", pb.tracking_lambda_tracking_dist_, -1.0);
+    nh.param("optimization/tracking_lambda_smoothness_yaw", pb.tracking_lambda_smoothness_yaw_, -1.0);
+    nh.param("optimization/tracking_lambda_feasibility_yaw", pb.tracking_lambda_feasibility_yaw_, -1.0);
+    nh.param("optimization/tracking_lambda_tracking_yaw_and_pos", pb.tracking_lambda_tracking_yaw_and_pos_, -1.0);
+    nh.param("optimization/tracking_lambda_safe_yaw", pb.tracking_lambda_safe_yaw_, -1.0);
     
   }
 
   void BsplineOptimizer::setEnvironment(const GridMap::Ptr &map)
   {
-    this->grid_map_ = map;
+    editProblem().grid_map_ = map;
   }
 
   void BsplineOptimizer::setEnvironment(const GridMap::Ptr &map, const fast_planner::ObjPredictor::Ptr mov_obj)
   {
-    this->grid_map_ = map;
-    this->moving_objs_ = mov_obj;
+    BsplineProblem &pb = editProblem();
+    pb.grid_map_ = map;
+    pb.moving_objs_ = mov_obj;
   }
 
   void BsplineOptimizer::setControlPoints(const Eigen::MatrixXd &points)
@@ -63,25 +75,27 @@ namespace ego_planner
 
   void BsplineOptimizer::setInitYaw(double init_yaw) 
   { 
-    init_yaw_ = init_yaw; 
-    init_yaw_sin_ = sin( -init_yaw_ );
-    init_yaw_cos_ = cos( -init_yaw_ );
+    BsplineProblem &pb = editProblem();
+    pb.init_yaw_ = init_yaw; 
+    pb.init_yaw_sin_ = sin( -pb.init_yaw_ );
+    pb.init_yaw_cos_ = cos( -pb.init_yaw_ );
   }
 
   void BsplineOptimizer::setVelYaw(double target_vel_yaw)
   {
-    target_vel_yaw_ = target_vel_yaw;
+    editProblem().target_vel_yaw_ = target_vel_yaw;
   }
 
-  void BsplineOptimizer::setSwarmTrajs(SwarmTrajData *swarm_trajs_ptr) { swarm_trajs_ = swarm_trajs_ptr; }
+  void BsplineOptimizer::setSwarmTrajs(SwarmTrajData *swarm_trajs_ptr) { editProblem().swarm_trajs_ = swarm_trajs_ptr; }
 
   void BsplineOptimizer::setDroneId(const int drone_id) 
   { 
-    drone_id_ = drone_id;
-    if( drone_id_ == 1 )
+    BsplineProblem &pb = editProblem();
+    pb.drone_id_ = drone_id;
+    if( pb.drone_id_ == 1 )
     {
-      max_vel_ = max_vel_;
-      max_acc_ = max_acc_;
+      pb.max_vel_ = pb.max_vel_;
+      pb.max_acc_ = pb.max_acc_;
     }
   }
   std::vector<ControlPoints> BsplineOptimizer::distinctiveTrajs(vector<std::pair<int, int>> segments)
@@ -100,7 +114,7 @@ namespace ego_planner
     int seg_upbound = std::min((int)segments.size(), static_cast<int>(floor(log(MAX_TRAJS) / log(VARIS))));
     std::vector<ControlPoints> control_pts_buf;
     control_pts_buf.reserve(MAX_TRAJS);
-    const double RESOLUTION = grid_map_->getResolution();
+    const double RESOLUTION = problem_->grid_map_->getResolution();
     const double CTRL_PT_DIST = (cps_.points.col(0) - cps_.points.col(cps_.size - 1)).norm() / (cps_.size - 1);
 
     // Step 1. Find the opposite vectors and base points for every segment.
@@ -145,7 +159,7 @@ namespace ego_planner
           {
             Eigen::Vector3d pt(a * RichInfoSegs[i].first.points.col(j) + (1 - a) * RichInfoSegs[i].first.points.col(j + 1));
             //cout << " " << grid_map_->getInflateOccupancy(pt) << " pt=" << pt.transpose() << endl;
-            if (grid_map_->getInflateOccupancy(pt))
+            if (problem_->grid_map_->getInflateOccupancy(pt))
             {
               occ_start_id = j;
               occ_start_pt = pt;
@@ -165,7 +179,7 @@ namespace ego_planner
             Eigen::Vector3d pt(a * RichInfoSegs[i].first.points.col(j) + (1 - a) * RichInfoSegs[i].first.points.col(j - 1));
             //cout << " " << grid_map_->getInflateOccupancy(pt) << " pt=" << pt.transpose() << endl;
             ;
-            if (grid_map_->getInflateOccupancy(pt))
+            if (problem_->grid_map_->getInflateOccupancy(pt))
             {
               occ_end_id = j;
               occ_end_pt = pt;
@@ -245,7 +259,7 @@ namespace ego_planner
             base_pt_reverse = RichInfoSegs[i].first.points.col(j) + base_vec_reverse * (RichInfoSegs[i].first.base_point[j][0] - RichInfoSegs[i].first.points.col(j)).norm();
           }
 
-          if (grid_map_->getInflateOccupancy(base_pt_reverse)) // Search outward.
+          if (problem_->grid_map_->getInflateOccupancy(base_pt_reverse)) // Search outward.
           {
             double l_upbound = 5 * CTRL_PT_DIST; // "5" is the threshold.
             double l = RESOLUTION;
@@ -253,7 +267,7 @@ namespace ego_planner
             {
               Eigen::Vector3d base_pt_temp = base_pt_reverse + l * base_vec_reverse;
               //cout << base_pt_temp.transpose() << endl;
-              if (!grid_map_->getInflateOccupancy(base_pt_temp))
+              if (!problem_->grid_map_->getInflateOccupancy(base_pt_temp))
               {
                 RichInfoSegs[i].second.base_point[j][0] = base_pt_temp;
                 RichInfoSegs[i].second.direction[j][0] = base_vec_reverse;
@@ -313,7 +327,7 @@ namespace ego_planner
         Eigen::Vector3d base_vec_reverse = -RichInfoSegs[i].first.direction[0][0];
         Eigen::Vector3d base_pt_reverse = RichInfoSegs[i].first.points.col(0) + base_vec_reverse * (RichInfoSegs[i].first.base_point[0][0] - RichInfoSegs[i].first.points.col(0)).norm();
 
-        if (grid_map_->getInflateOccupancy(base_pt_reverse)) // Search outward.
+        if (problem_->grid_map_->getInflateOccupancy(base_pt_reverse)) // Search outward.
         {
           double l_upbound = 5 * CTRL_PT_DIST; // "5" is the threshold.
           double l = RESOLUTION;
@@ -321,7 +335,7 @@ namespace ego_planner
           {
             Eigen::Vector3d base_pt_temp = base_pt_reverse + l * base_vec_reverse;
             //cout << base_pt_temp.transpose() << endl;
-            if (!grid_map_->getInflateOccupancy(base_pt_temp))
+            if (!problem_->grid_map_->getInflateOccupancy(base_pt_temp))
             {
               RichInfoSegs[i].second.base_point[0][0] = base_pt_temp;
               RichInfoSegs[i].second.direction[0][0] = base_vec_reverse;
@@ -473,33 +487,33 @@ namespace ego_planner
 
     if (flag_first_init)
     {
-      cps_.clearance = dist0_;
+      cps_.clearance = problem_->dist0_;
       cps_.resize(init_points.cols());
       cps_.points = init_points;
     }
 
     /*** Segment the initial trajectory according to obstacles ***/
     constexpr int ENOUGH_INTERVAL = 2;
-    double step_size = grid_map_->getResolution() / ((init_points.col(0) - init_points.rightCols(1)).norm() / (init_points.cols() - 1)) / 1.5;
+    double step_size = problem_->grid_map_->getResolution() / ((init_points.col(0) - init_points.rightCols(1)).norm() / (init_points.cols() - 1)) / 1.5;
     int in_id, out_id;
     vector<std::pair<int, int>> segment_ids;
     int same_occ_state_times = ENOUGH_INTERVAL + 1;
     bool occ, last_occ = false;
     bool flag_got_start = false, flag_got_end = false, flag_got_end_maybe = false;
-    int i_end = (int)init_points.cols() - order_ - ((int)init_points.cols() - 2 * order_) / 3; // only check closed 2/3 points.
-    for (int i = order_; i <= i_end; ++i)
+    int i_end = (int)init_points.cols() - problem_->order_ - ((int)init_points.cols() - 2 * problem_->order_) / 3; // only check closed 2/3 points.
+    for (int i = problem_->order_; i <= i_end; ++i)
     {
       //cout << " *" << i-1 << "*" ;
       for (double a = 1.0; a > 0.0; a -= step_size)
       {
-        occ = grid_map_->getInflateOccupancy(a * init_points.col(i - 1) + (1 - a) * init_points.col(i));
+        occ = problem_->grid_map_->getInflateOccupancy(a * init_points.col(i - 1) + (1 - a) * init_points.col(i));
         //cout << " " << occ;
         // cout << setprecision(5);
         // cout << (a * init_points.col(i-1) + (1-a) * init_points.col(i)).transpose() << " occ1=" << occ << endl;
 
         if (occ && !last_occ)
         {
-          if (same_occ_state_times > ENOUGH_INTERVAL || i == order_)
+          if (same_occ_state_times > ENOUGH_INTERVAL || i == problem_->order_)
           {
             in_id = i - 1;
             flag_got_start = true;
@@ -518,7 +532,7 @@ namespace ego_planner
           ++same_occ_state_times;
         }
 
-        if (flag_got_end_maybe && (same_occ_state_times > ENOUGH_INTERVAL || (i == (int)init_points.cols() - order_)))
+        if (flag_got_end_maybe && (same_occ_state_times > ENOUGH_INTERVAL || (i == (int)init_points.cols() - problem_->order_)))
         {
           flag_got_end_maybe = false;
           flag_got_end = true;
@@ -574,20 +588,20 @@ namespace ego_planner
 
       if (i == 0) // first segment
       {
-        id_low_bound = order_;
+        id_low_bound = problem_->order_;
         if (segment_ids.size() > 1)
         {
           id_up_bound = (int)(((segment_ids[0].second + segment_ids[1].first) - 1.0f) / 2); // id_up_bound : -1.0f fix()
         }
         else
         {
-          id_up_bound = init_points.cols() - order_ - 1;
+          id_up_bound = init_points.cols() - problem_->order_ - 1;
         }
       }
       else if (i == segment_ids.size() - 1) // last segment, i != 0 here
       {
         id_low_bound = (int)(((segment_ids[i].first + segment_ids[i - 1].second) + 1.0f) / 2); // id_low_bound : +1.0f ceil()
-        id_up_bound = init_points.cols() - order_ - 1;
+        id_up_bound = init_points.cols() - problem_->order_ - 1;
       }
       else
       {
@@ -688,14 +702,14 @@ namespace ego_planner
           double length = (intersection_point - init_points.col(j)).norm();
           if (length > 1e-5)
           {
-            for (double a = length; a >= 0.0; a -= grid_map_->getResolution())
+            for (double a = length; a >= 0.0; a -= problem_->grid_map_->getResolution())
             {
-              occ = grid_map_->getInflateOccupancy((a / length) * intersection_point + (1 - a / length) * init_points.col(j));
+              occ = problem_->grid_map_->getInflateOccupancy((a / length) * intersection_point + (1 - a / length) * init_points.col(j));
 
-              if (occ || a < grid_map_->getResolution())
+              if (occ || a < problem_->grid_map_->getResolution())
               {
                 if (occ)
-                  a += grid_map_->getResolution();
+                  a += problem_->grid_map_->getResolution();
                 cps_.base_point[j].push_back((a / length) * intersection_point + (1 - a / length) * init_points.col(j));
                 cps_.direction[j].push_back((intersection_point - init_points.col(j)).normalized());
                 // cout << "A " << j << endl;
@@ -782,6 +796,16 @@ namespace ego_planner
     BsplineOptimizer *opt = reinterpret_cast<BsplineOptimizer *>(func_data);
     // cout << "k=" << k << endl;
     // cout << "opt->flag_continue_to_optimize_=" << opt->flag_continue_to_optimize_ << endl;
+    // k is always 0 here since the solver reports progress from the line search only,
+    // so the evaluations of the current solve decide when the bound may stop it
+    constexpr int MIN_ITER_BEFORE_BOUND = 10;
+    opt->cost_history_.push_back(fx);
+    if (opt->cost_bound_ != NULL && opt->iter_num_ > MIN_ITER_BEFORE_BOUND &&
+        fx > opt->cost_bound_ratio_ * (*opt->cost_bound_)[std::min(opt->cost_history_.size(), opt->cost_bound_->size()) - 1])
+    {
+      opt->flag_cost_bound_stop_ = true;
+      return 1;
+    }
     return (opt->force_stop_type_ == STOP_FOR_ERROR || opt->force_stop_type_ == STOP_FOR_REBOUND);
   }
 
@@ -813,7 +837,7 @@ namespace ego_planner
   {
     cost = 0.0;
     
-    double max_dist_threshold = best_attract_max_dist_;
+    double max_dist_threshold = problem_->best_attract_max_dist_;
     double t_now = ros::Time::now().toSec();
 
     for(size_t i_attract = 0; i_attract < attract_pts_.size() * 2 / 3.0; i_attract++)
@@ -842,7 +866,7 @@ namespace ego_planner
   void BsplineOptimizer::calcSwarmCost(const Eigen::MatrixXd &q, double &cost, Eigen::MatrixXd &gradient)
   {
     cost = 0.0;
-    double min_dist_threshold = best_attract_min_dist_;
+    double min_dist_threshold = problem_->best_attract_min_dist_;
 
     for(size_t i_attract = 0; i_attract < attract_pts_.size(); i_attract++)
     {
@@ -870,17 +894,17 @@ namespace ego_planner
   void BsplineOptimizer::calcMovingObjCost(const Eigen::MatrixXd &q, double &cost, Eigen::MatrixXd &gradient)
   {
     cost = 0.0;
-    int end_idx = q.cols() - order_;
+    int end_idx = q.cols() - problem_->order_;
     constexpr double CLEARANCE = 1.5;
     double t_now = ros::Time::now().toSec();
 
-    for (int i = order_; i < end_idx; i++)
+    for (int i = problem_->order_; i < end_idx; i++)
     {
-      double time = ((double)(order_ - 1) / 2 + (i - order_ + 1)) * bspline_interval_;
+      double time = ((double)(problem_->order_ - 1) / 2 + (i - problem_->order_ + 1)) * bspline_interval_;
 
-      for (int id = 0; id < moving_objs_->getObjNums(); id++)
+      for (int id = 0; id < problem_->moving_objs_->getObjNums(); id++)
       {
-        Eigen::Vector3d obj_prid = moving_objs_->evaluateConstVel(id, t_now + time);
+        Eigen::Vector3d obj_prid = problem_->moving_objs_->evaluateConstVel(id, t_now + time);
         double dist = (cps_.points.col(i) - obj_prid).norm();
         //cout /*<< "cps_.points.col(i)=" << cps_.points.col(i).transpose()*/ << " moving_objs_=" << obj_prid.transpose() << " dist=" << dist << endl;
         double dist_err = CLEARANCE - dist;
@@ -906,18 +930,18 @@ namespace ego_planner
                                                  Eigen::MatrixXd &gradient, int iter_num, double smoothness_cost)
   {
     cost = 0.0;
-    int end_idx = q.cols() - order_;
+    int end_idx = q.cols() - problem_->order_;
     double demarcation = cps_.clearance;
     double a = 3 * demarcation, b = -3 * pow(demarcation, 2), c = pow(demarcation, 3);
 
     force_stop_type_ = DONT_STOP;
-    if (iter_num > 3 && smoothness_cost / (cps_.size - 2 * order_) < 0.1) // 0.1 is an experimental value that indicates the trajectory is smooth enough.
+    if (iter_num > 3 && smoothness_cost / (cps_.size - 2 * problem_->order_) < 0.1) // 0.1 is an experimental value that indicates the trajectory is smooth enough.
     {
       check_collision_and_rebound();
     }
 
     /*** calculate distance cost and gradient ***/
-    for (auto i = order_; i < end_idx; ++i)
+    for (auto i = problem_->order_; i < end_idx; ++i)
     {
       for (size_t j = 0; j < cps_.direction[i].size(); ++j)
       {
@@ -948,11 +972,11 @@ namespace ego_planner
 
     cost = 0.0;
 
-    int end_idx = q.cols() - order_;
+    int end_idx = q.cols() - problem_->order_;
 
     // def: f = |x*v|^2/a^2 + |x×v|^2/b^2
     double a2 = 25, b2 = 1;
-    for (auto i = order_ - 1; i < end_idx + 1; ++i)
+    for (auto i = problem_->order_ - 1; i < end_idx + 1; ++i)
     {
       Eigen::Vector3d x = (q.col(i - 1) + 4 * q.col(i) + q.col(i + 1)) / 6.0 - ref_pts_[i - 1];
       Eigen::Vector3d v = (ref_pts_[i] - ref_pts_[i - 2]).normalized();
@@ -1024,7 +1048,7 @@ namespace ego_planner
     q_2 = q.col(q.cols()-2);
     q_1 = q.col(q.cols()-1);
 
-    dq = 1 / 6.0 * (q_3 + 4 * q_2 + q_1) - local_target_pt_;
+    dq = 1 / 6.0 * (q_3 + 4 * q_2 + q_1) - problem_->local_target_pt_;
     cost += dq.squaredNorm();
 
     gradient.col(q.cols()-3) += 2 * dq * (1 / 6.0);
@@ -1059,18 +1083,18 @@ namespace ego_planner
 
       for (int j = 0; j < 3; j++)
       {
-        if (vi(j) > max_vel_ + demarcation)
+        if (vi(j) > problem_->max_vel_ + demarcation)
         {
-          double diff = vi(j) - max_vel_;
+          double diff = vi(j) - problem_->max_vel_;
           cost += (ar * diff * diff + br * diff + cr) * ts_inv3; // multiply ts_inv3 to make vel and acc has similar magnitude
 
           double grad = (2.0 * ar * diff + br) / ts * ts_inv3;
           gradient(j, i + 0) += -grad;
           gradient(j, i + 1) += grad;
         }
-        else if (vi(j) > max_vel_)
+        else if (vi(j) > problem_->max_vel_)
         {
-          double diff = vi(j) - max_vel_;
+          double diff = vi(j) - problem_->max_vel_;
           cost += pow(diff, 3) * ts_inv3;
           ;
 
@@ -1079,18 +1103,18 @@ namespace ego_planner
           gradient(j, i + 0) += -grad;
           gradient(j, i + 1) += grad;
         }
-        else if (vi(j) < -(max_vel_ + demarcation))
+        else if (vi(j) < -(problem_->max_vel_ + demarcation))
         {
-          double diff = vi(j) + max_vel_;
+          double diff = vi(j) + problem_->max_vel_;
           cost += (al * diff * diff + bl * diff + cl) * ts_inv3;
 
           double grad = (2.0 * al * diff + bl) / ts * ts_inv3;
           gradient(j, i + 0) += -grad;
           gradient(j, i + 1) += grad;
         }
-        else if (vi(j) < -max_vel_)
+        else if (vi(j) < -problem_->max_vel_)
         {
-          double diff = vi(j) + max_vel_;
+          double diff = vi(j) + problem_->max_vel_;
           cost += -pow(diff, 3) * ts_inv3;
 
           double grad = -3 * diff * diff / ts * ts_inv3;
@@ -1111,9 +1135,9 @@ namespace ego_planner
 
       for (int j = 0; j < 3; j++)
       {
-        if (ai(j) > max_acc_ + demarcation)
+        if (ai(j) > problem_->max_acc_ + demarcation)
         {
-          double diff = ai(j) - max_acc_;
+          double diff = ai(j) - problem_->max_acc_;
           cost += ar * diff * diff + br * diff + cr;
 
           double grad = (2.0 * ar * diff + br) * ts_inv2;
@@ -1121,9 +1145,9 @@ namespace ego_planner
           gradient(j, i + 1) += -2 * grad;
           gradient(j, i + 2) += grad;
         }
-        else if (ai(j) > max_acc_)
+        else if (ai(j) > problem_->max_acc_)
         {
-          double diff = ai(j) - max_acc_;
+          double diff = ai(j) - problem_->max_acc_;
           cost += pow(diff, 3);
 
           double grad = 3 * diff * diff * ts_inv2;
@@ -1131,9 +1155,9 @@ namespace ego_planner
           gradient(j, i + 1) += -2 * grad;
           gradient(j, i + 2) += grad;
         }
-        else if (ai(j) < -(max_acc_ + demarcation))
+        else if (ai(j) < -(problem_->max_acc_ + demarcation))
         {
-          double diff = ai(j) + max_acc_;
+          double diff = ai(j) + problem_->max_acc_;
           cost += al * diff * diff + bl * diff + cl;
 
           double grad = (2.0 * al * diff + bl) * ts_inv2;
@@ -1141,9 +1165,9 @@ namespace ego_planner
           gradient(j, i + 1) += -2 * grad;
           gradient(j, i + 2) += grad;
         }
-        else if (ai(j) < -max_acc_)
+        else if (ai(j) < -problem_->max_acc_)
         {
-          double diff = ai(j) + max_acc_;
+          double diff = ai(j) + problem_->max_acc_;
           cost += -pow(diff, 3);
 
           double grad = -3 * diff * diff * ts_inv2;
@@ -1177,21 +1201,21 @@ namespace ego_planner
       //cout << "temp_v * vi=" ;
       for (int j = 0; j < 3; j++)
       {
-        if (vi(j) > max_vel_)
+        if (vi(j) > problem_->max_vel_)
         {
           // cout << "zx-todo VEL" << endl;
           // cout << vi(j) << endl;
-          cost += pow(vi(j) - max_vel_, 2) * ts_inv2; // multiply ts_inv3 to make vel and acc has similar magnitude
+          cost += pow(vi(j) - problem_->max_vel_, 2) * ts_inv2; // multiply ts_inv3 to make vel and acc has similar magnitude
 
-          gradient(j, i + 0) += -2 * (vi(j) - max_vel_) / ts * ts_inv2;
-          gradient(j, i + 1) += 2 * (vi(j) - max_vel_) / ts * ts_inv2;
+          gradient(j, i + 0) += -2 * (vi(j) - problem_->max_vel_) / ts * ts_inv2;
+          gradient(j, i + 1) += 2 * (vi(j) - problem_->max_vel_) / ts * ts_inv2;
         }
-        else if (vi(j) < -max_vel_)
+        else if (vi(j) < -problem_->max_vel_)
         {
-          cost += pow(vi(j) + max_vel_, 2) * ts_inv2;
+          cost += pow(vi(j) + problem_->max_vel_, 2) * ts_inv2;
 
-          gradient(j, i + 0) += -2 * (vi(j) + max_vel_) / ts * ts_inv2;
-          gradient(j, i + 1) += 2 * (vi(j) + max_vel_) / ts * ts_inv2;
+          gradient(j, i + 0) += -2 * (vi(j) + problem_->max_vel_) / ts * ts_inv2;
+          gradient(j, i + 1) += 2 * (vi(j) + problem_->max_vel_) / ts * ts_inv2;
         }
         else
         {
@@ -1208,23 +1232,23 @@ namespace ego_planner
       //cout << "temp_a * ai=" ;
       for (int j = 0; j < 3; j++)
       {
-        if (ai(j) > max_acc_)
+        if (ai(j) > problem_->max_acc_)
         {
           // cout << "zx-todo ACC" << endl;
           // cout << ai(j) << endl;
-          cost += pow(ai(j) - max_acc_, 2);
+          cost += pow(ai(j) - problem_->max_acc_, 2);
 
-          gradient(j, i + 0) += 2 * (ai(j) - max_acc_) * ts_inv2;
-          gradient(j, i + 1) += -4 * (ai(j) - max_acc_) * ts_inv2;
-          gradient(j, i + 2) += 2 * (ai(j) - max_acc_) * ts_inv2;
+          gradient(j, i + 0) += 2 * (ai(j) - problem_->max_acc_) * ts_inv2;
+          gradient(j, i + 1) += -4 * (ai(j) - problem_->max_acc_) * ts_inv2;
+          gradient(j, i + 2) += 2 * (ai(j) - problem_->max_acc_) * ts_inv2;
         }
-        else if (ai(j) < -max_acc_)
+        else if (ai(j) < -problem_->max_acc_)
         {
-          cost += pow(ai(j) + max_acc_, 2);
+          cost += pow(ai(j) + problem_->max_acc_, 2);
 
-          gradient(j, i + 0) += 2 * (ai(j) + max_acc_) * ts_inv2;
-          gradient(j, i + 1) += -4 * (ai(j) + max_acc_) * ts_inv2;
-          gradient(j, i + 2) += 2 * (ai(j) + max_acc_) * ts_inv2;
+          gradient(j, i + 0) += 2 * (ai(j) + problem_->max_acc_) * ts_inv2;
+          gradient(j, i + 1) += -4 * (ai(j) + problem_->max_acc_) * ts_inv2;
+          gradient(j, i + 2) += 2 * (ai(j) + problem_->max_acc_) * ts_inv2;
         }
         else
         {
@@ -1240,17 +1264,17 @@ namespace ego_planner
   bool BsplineOptimizer::check_collision_and_rebound(void)
   {
 
-    int end_idx = cps_.size - order_;
+    int end_idx = cps_.size - problem_->order_;
 
     /*** Check and segment the initial trajectory according to obstacles ***/
     int in_id, out_id;
     vector<std::pair<int, int>> segment_ids;
     bool flag_new_obs_valid = false;
-    int i_end = end_idx - (end_idx - order_) / 3;
-    for (int i = order_ - 1; i <= i_end; ++i)
+    int i_end = end_idx - (end_idx - problem_->order_) / 3;
+    for (int i = problem_->order_ - 1; i <= i_end; ++i)
     {
 
-      bool occ = grid_map_->getInflateOccupancy(cps_.points.col(i));
+      bool occ = problem_->grid_map_->getInflateOccupancy(cps_.points.col(i));
 
       /*** check if the new collision will be valid ***/
       if (occ)
@@ -1258,7 +1282,7 @@ namespace ego_planner
         for (size_t k = 0; k < cps_.direction[i].size(); ++k)
         {
           cout.precision(2);
-          if ((cps_.points.col(i) - cps_.base_point[i][k]).dot(cps_.direction[i][k]) < 1 * grid_map_->getResolution()) // current point is outside all the collision_points.
+          if ((cps_.points.col(i) - cps_.base_point[i][k]).dot(cps_.direction[i][k]) < 1 * problem_->grid_map_->getResolution()) // current point is outside all the collision_points.
           {
             occ = false; // Not really takes effect, just for better hunman understanding.
             break;
@@ -1273,7 +1297,7 @@ namespace ego_planner
         int j;
         for (j = i - 1; j >= 0; --j)
         {
-          occ = grid_map_->getInflateOccupancy(cps_.points.col(j));
+          occ = problem_->grid_map_->getInflateOccupancy(cps_.points.col(j));
           if (!occ)
           {
             in_id = j;
@@ -1288,7 +1312,7 @@ namespace ego_planner
 
         for (j = i + 1; j < cps_.size; ++j)
         {
-          occ = grid_map_->getInflateOccupancy(cps_.points.col(j));
+          occ = problem_->grid_map_->getInflateOccupancy(cps_.points.col(j));
 
           if (!occ)
           {
@@ -1385,14 +1409,14 @@ namespace ego_planner
             double length = (intersection_point - cps_.points.col(j)).norm();
             if (length > 1e-5)
             {
-              for (double a = length; a >= 0.0; a -= grid_map_->getResolution())
+              for (double a = length; a >= 0.0; a -= problem_->grid_map_->getResolution())
               {
-                bool occ = grid_map_->getInflateOccupancy((a / length) * intersection_point + (1 - a / length) * cps_.points.col(j));
+                bool occ = problem_->grid_map_->getInflateOccupancy((a / length) * intersection_point + (1 - a / length) * cps_.points.col(j));
 
-                if (occ || a < grid_map_->getResolution())
+                if (occ || a < problem_->grid_map_->getResolution())
                 {
                   if (occ)
-                    a += grid_map_->getResolution();
+                    a += problem_->grid_map_->getResolution();
                   cps_.base_point[j].push_back((a / length) * intersection_point + (1 - a / length) * cps_.points.col(j));
                   cps_.direction[j].push_back((intersection_point - cps_.points.col(j)).normalized());
                   break;
@@ -1472,25 +1496,116 @@ namespace ego_planner
     return flag_success;
   }
 
+  void BsplineOptimizer::optimizeCandidates(const std::vector<BsplineOptimizer *> &optimizers, ThreadPool *pool,
+                                            const std::vector<ControlPoints> &trajs, double ts, double cost_ratio,
+                                            std::vector<Eigen::MatrixXd> &optimal_points, std::vector<double> &final_costs,
+                                            std::vector<char> &success)
+  {
+    const int traj_num = trajs.size();
+    optimal_points.assign(traj_num, Eigen::MatrixXd());
+    final_costs.assign(traj_num, 0.0);
+    success.assign(traj_num, 0);
+    if (traj_num == 0)
+      return;
+
+    // every solve starts cold, the candidate solved before on the same optimizer depends on the thread count
+    BsplineOptimizer &first = *optimizers[0];
+    first.clearWarmStart();
+    first.setCostBound(NULL, cost_ratio);
+    success[0] = first.BsplineOptimizeTrajRebound(optimal_points[0], final_costs[0], trajs[0], ts);
+
+    // mid-solve costs are compared with the first candidate's cost at the same point of its solve, not its final cost
+    std::vector<double> reference_costs = first.getCostHistory();
+    reference_costs.push_back(final_costs[0]);
+    const bool use_bound = success[0] && cost_ratio > 0;
+
+    auto solve = [&](int thread_id, int begin, int end) {
+      BsplineOptimizer &opt = *optimizers[thread_id];
+      opt.setCostBound(use_bound ? &reference_costs : NULL, cost_ratio);
+      for (int i = end; i > begin; i--) // candidates 1 to traj_num - 1
+      {
+        opt.clearWarmStart();
+        success[i] = opt.BsplineOptimizeTrajRebound(optimal_points[i], final_costs[i], trajs[i], ts);
+      }
+    };
+
+    if (pool)
+      pool->parallelFor(traj_num - 1, solve);
+    else
+      solve(0, 0, traj_num - 1);
+
+    for (BsplineOptimizer *opt : optimizers)
+      opt->setCostBound(NULL, cost_ratio);
+  }
+
   bool BsplineOptimizer::if_equal( double x, double y )
   {
     double x_y = abs((x - y)/x);
     return (x_y < 0.05);
   }
 
+  /* The initial control points of a replan are the last trajectory resampled from
+     the current time, so they match the last optimum shifted by a few knots.
+     Find that shift and re-index the stored L-BFGS corrections accordingly. */
+  bool BsplineOptimizer::prepareWarmStart(int start_id)
+  {
+    const int max_shift = 5;
+
+    if (warm_memory_.count == 0 || warm_points_.cols() == 0 ||
+        fabs(warm_interval_ - bspline_interval_) > 1e-6)
+    {
+      warm_memory_.count = 0;
+      return false;
+    }
+
+    int free_num = cps_.points.cols() - start_id;
+    int best_shift = -1;
+    double best_err = std::numeric_limits<double>::max();
+    for (int shift = 0; shift <= max_shift; ++shift)
+    {
+      int overlap = std::min(free_num, (int)warm_points_.cols() - start_id - shift);
+      if (overlap < free_num / 2 || overlap <= 0)
+        break;
+
+      double err = (cps_.points.block(0, start_id, 3, overlap) - warm_points_.block(0, start_id + shift, 3, overlap)).colwise().norm().mean();
+      if (err < best_err)
+      {
+        best_err = err;
+        best_shift = shift;
+      }
+    }
+
+    // the new problem is not a perturbation of the last one
+    if (best_shift < 0 || best_err > problem_->max_vel_ * bspline_interval_)
+    {
+      warm_memory_.count = 0;
+      return false;
+    }
+
+    lbfgs::lbfgs_memory_shift(&warm_memory_, 3 * best_shift, variable_num_);
+    return warm_memory_.count > 0;
+  }
+
   bool BsplineOptimizer::rebound_optimize(double &final_cost)
   {
     iter_num_ = 0;
-    int start_id = order_;
+    int start_id = problem_->order_;
     // int end_id = this->cps_.size - order_; //Fixed end 
     int end_id = this->cps_.size; // Free end 
     variable_num_ = 3 * (end_id - start_id);
 
+    bool warm = problem_->warm_start_ && prepareWarmStart(start_id);
+    bool use_memory = warm; // restarts change the problem, only the first attempt reads the memory
+    int total_iter = 0;
+    warm_points_.resize(3, 0); // valid again only if this solve succeeds
+
     ros::Time t0 = ros::Time::now(), t1, t2;
     int restart_nums = 0, rebound_times = 0;
     ;
     bool flag_force_return, flag_occ, success;
-    new_lambda2_ = lambda2_;
+    new_lambda2_ = problem_->lambda2_;
+    flag_cost_bound_stop_ = false;
+    cost_history_.clear();
     constexpr int MAX_RESART_NUMS_SET = 3;
     t_now_for_swarm_ = ros::Time::now().toSec();
 
@@ -1500,21 +1615,21 @@ namespace ego_planner
     attract_pts_cor_drone_.clear();
     double t_now = ros::Time::now().toSec();
 
-    for (int i = order_; i < end_id; i++)
+    for (int i = problem_->order_; i < end_id; i++)
     {
-      double glb_time = t_now + ((double)(order_ - 1) / 2 + (i - order_ + 1)) * bspline_interval_;
-      for (size_t id = 0; id < swarm_trajs_->size(); id++)
+      double glb_time = t_now + ((double)(problem_->order_ - 1) / 2 + (i - problem_->order_ + 1)) * bspline_interval_;
+      for (size_t id = 0; id < problem_->swarm_trajs_->size(); id++)
       {
-        if ( (swarm_trajs_->at(id).drone_id != (int)id) || swarm_trajs_->at(id).drone_id == drone_id_ )
+        if ( (problem_->swarm_trajs_->at(id).drone_id != (int)id) || problem_->swarm_trajs_->at(id).drone_id == problem_->drone_id_ )
         {
           continue;
         }
-        double traj_i_satrt_time = swarm_trajs_->at(id).start_time_.toSec();
-        if (glb_time < traj_i_satrt_time + swarm_trajs_->at(id).duration_ - 0.1)
+        double traj_i_satrt_time = problem_->swarm_trajs_->at(id).start_time_.toSec();
+        if (glb_time < traj_i_satrt_time + problem_->swarm_trajs_->at(id).duration_ - 0.1)
         {
-          double max_dis = attract_max_dist_threshold_;
+          double max_dis = problem_->attract_max_dist_threshold_;
 
-          Eigen::Vector3d swarm_prid = swarm_trajs_->at(id).position_traj_.evaluateDeBoorT(glb_time - traj_i_satrt_time);
+          Eigen::Vector3d swarm_prid = problem_->swarm_trajs_->at(id).position_traj_.evaluateFixedT<3, 3>(glb_time - traj_i_satrt_time);
           Eigen::Vector3d drone_pos = cps_.points.col(i);
           Eigen::Vector3d dist_vec = drone_pos - swarm_prid;
           double dist = sqrt(dist_vec(0) * dist_vec(0) + dist_vec(1) * dist_vec(1));
@@ -1547,12 +1662,24 @@ namespace ego_planner
       lbfgs_params.g_epsilon = 0.01;
 
       /* ---------- optimize ---------- */
+      // with warm start on, the memory is still passed to keep the corrections of this solve for the next replan
+      if (!use_memory)
+        warm_memory_.count = 0;
+      use_memory = false;
       t1 = ros::Time::now();
-      int result = lbfgs::lbfgs_optimize(variable_num_, q, &final_cost, BsplineOptimizer::costFunctionRebound, NULL, BsplineOptimizer::earlyExit, this, &lbfgs_params);
+      int result = lbfgs::lbfgs_optimize(variable_num_, q, &final_cost, BsplineOptimizer::costFunctionRebound, NULL, BsplineOptimizer::earlyExit, this, &lbfgs_params,
+                                         problem_->warm_start_ ? &warm_memory_ : NULL);
       t2 = ros::Time::now();
+      total_iter += iter_num_;
       double time_ms = (t2 - t1).toSec() * 1000;
       double total_time_ms = (t2 - t0).toSec() * 1000;
 
+      if (flag_cost_bound_stop_) // the first candidate was much cheaper at this point
+      {
+        printf("\033[33miter=%d,time(ms)=%5.3f, cost %f above bound, give up\n\033[0m", iter_num_, total_time_ms, final_cost);
+        return false;
+      }
+
       /* ---------- success temporary, check collision again ---------- */
       if (result == lbfgs::LBFGS_CONVERGENCE ||
           result == lbfgs::LBFGSERR_MAXIMUMITERATION ||
@@ -1563,7 +1690,7 @@ namespace ego_planner
         flag_force_return = false;
 
         /*** collision check, phase 1 ***/
-        if ((min_ellip_dist_ != INIT_min_ellip_dist_) && (min_ellip_dist_ > swarm_clearance_))
+        if ((min_ellip_dist_ != INIT_min_ellip_dist_) && (min_ellip_dist_ > problem_->swarm_clearance_))
         {
           success = false;
           restart_nums++;
@@ -1579,10 +1706,10 @@ namespace ego_planner
         UniformBspline traj = UniformBspline(cps_.points, 3, bspline_interval_);
         double tm, tmp;
         traj.getTimeSpan(tm, tmp);
-        double t_step = (tmp - tm) / ((traj.evaluateDeBoorT(tmp) - traj.evaluateDeBoorT(tm)).norm() / grid_map_->getResolution());
+        double t_step = (tmp - tm) / ((traj.evaluateDeBoorT(tmp) - traj.evaluateDeBoorT(tm)).norm() / problem_->grid_map_->getResolution());
         for (double t = tm; t < tmp * 2 / 3; t += t_step) // Only check the closest 2/3 partition of the whole trajectory.
         {
-          flag_occ = grid_map_->getInflateOccupancy(traj.evaluateDeBoorT(t));
+          flag_occ = problem_->grid_map_->getInflateOccupancy(traj.evaluateDeBoorT(t));
           if (flag_occ)
           {
             //cout << "hit_obs, t=" << t << " P=" << traj.evaluateDeBoorT(t).transpose() << endl;
@@ -1651,8 +1778,25 @@ namespace ego_planner
 
         if (!flag_occ)
         {
-          printf("\033[32miter(+1)=%d,time(ms)=%5.3f,total_t(ms)=%5.3f,cost=%5.3f\n\033[0m", iter_num_, time_ms, total_time_ms, final_cost);
           success = true;
+
+          ++solve_count_;
+          iter_count_ += total_iter;
+          if (warm)
+          {
+            ++warm_count_;
+            warm_iter_count_ += total_iter;
+          }
+          if (problem_->warm_start_)
+          {
+            warm_points_ = cps_.points;
+            warm_interval_ = bspline_interval_;
+          }
+
+          printf("\033[32miter(+1)=%d,time(ms)=%5.3f,total_t(ms)=%5.3f,cost=%5.3f,warm=%d,avg_iter(cold/warm)=%.1f/%.1f\n\033[0m",
+                 iter_num_, time_ms, total_time_ms, final_cost, (int)warm,
+                 solve_count_ > warm_count_ ? (double)(iter_count_ - warm_iter_count_) / (solve_count_ - warm_count_) : 0.0,
+                 warm_count_ > 0 ? (double)warm_iter_count_ / warm_count_ : 0.0);
         }
         else // restart
         {
@@ -1676,7 +1820,7 @@ namespace ego_planner
       }
 
     } while (
-        ((flag_occ || ((min_ellip_dist_ != INIT_min_ellip_dist_) && (min_ellip_dist_ > swarm_clearance_))) && restart_nums < MAX_RESART_NUMS_SET) ||
+        ((flag_occ || ((min_ellip_dist_ != INIT_min_ellip_dist_) && (min_ellip_dist_ > problem_->swarm_clearance_))) && restart_nums < MAX_RESART_NUMS_SET) ||
         (flag_force_return && force_stop_type_ == STOP_FOR_REBOUND && rebound_times <= 20));
 
     return success;
@@ -1685,8 +1829,8 @@ namespace ego_planner
   bool BsplineOptimizer::refine_optimize()
   {
     iter_num_ = 0;
-    int start_id = order_;
-    int end_id = this->cps_.points.cols() - order_;
+    int start_id = problem_->order_;
+    int end_id = this->cps_.points.cols() - problem_->order_;
     variable_num_ = 3 * (end_id - start_id);
 
     double q[variable_num_];
@@ -1694,7 +1838,7 @@ namespace ego_planner
 
     memcpy(q, cps_.points.data() + 3 * start_id, variable_num_ * sizeof(q[0]));
 
-    double origin_lambda4 = lambda4_;
+    new_lambda4_ = problem_->lambda4_;
     bool flag_safe = true;
     int iter_count = 0;
     do
@@ -1721,10 +1865,10 @@ namespace ego_planner
       UniformBspline traj = UniformBspline(cps_.points, 3, bspline_interval_);
       double tm, tmp;
       traj.getTimeSpan(tm, tmp);
-      double t_step = (tmp - tm) / ((traj.evaluateDeBoorT(tmp) - traj.evaluateDeBoorT(tm)).norm() / grid_map_->getResolution()); // Step size is defined as the maximum size that can passes throgth every gird.
+      double t_step = (tmp - tm) / ((traj.evaluateDeBoorT(tmp) - traj.evaluateDeBoorT(tm)).norm() / problem_->grid_map_->getResolution()); // Step size is defined as the maximum size that can passes throgth every gird.
       for (double t = tm; t < tmp * 2 / 3; t += t_step)
       {
-        if (grid_map_->getInflateOccupancy(traj.evaluateDeBoorT(t)))
+        if (problem_->grid_map_->getInflateOccupancy(traj.evaluateDeBoorT(t)))
         {
           // cout << "Refined traj hit_obs, t=" << t << " P=" << traj.evaluateDeBoorT(t).transpose() << endl;
 
@@ -1740,13 +1884,11 @@ namespace ego_planner
       }
 
       if (!flag_safe)
-        lambda4_ *= 2;
+        new_lambda4_ *= 2;
 
       iter_count++;
     } while (!flag_safe && iter_count <= 0);
 
-    lambda4_ = origin_lambda4;
-
     //cout << "iter_num_=" << iter_num_ << endl;
 
     return flag_safe;
@@ -1755,56 +1897,56 @@ namespace ego_planner
   void BsplineOptimizer::combineCostRebound(const double *x, double *grad, double &f_combine, const int n)
   {
 
-    memcpy(cps_.points.data() + 3 * order_, x, n * sizeof(x[0]));
+    memcpy(cps_.points.data() + 3 * problem_->order_, x, n * sizeof(x[0]));
 
     /* ---------- evaluate cost and gradient ---------- */
-    double f_smoothness, f_distance, f_feasibility /*, f_mov_objs*/, f_swarm, f_terminal, f_swarm_attract;
+    double f_smoothness, f_distance, f_feasibility /*, f_mov_objs*/, f_swarm = 0, f_terminal = 0, f_swarm_attract = 0;
 
-    Eigen::MatrixXd g_smoothness = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_distance = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_feasibility = Eigen::MatrixXd::Zero(3, cps_.size);
+    g_smoothness_.setZero(3, cps_.size);
+    g_distance_.setZero(3, cps_.size);
+    g_feasibility_.setZero(3, cps_.size);
     // Eigen::MatrixXd g_mov_objs = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_swarm_attract = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_swarm = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_terminal = Eigen::MatrixXd::Zero(3, cps_.size);
+    g_swarm_attract_.setZero(3, cps_.size);
+    g_swarm_.setZero(3, cps_.size);
+    g_terminal_.setZero(3, cps_.size);
 
-    calcSmoothnessCost(cps_.points, f_smoothness, g_smoothness);
-    calcDistanceCostRebound(cps_.points, f_distance, g_distance, iter_num_, f_smoothness);
-    calcFeasibilityCost(cps_.points, f_feasibility, g_feasibility);
+    calcSmoothnessCost(cps_.points, f_smoothness, g_smoothness_);
+    calcDistanceCostRebound(cps_.points, f_distance, g_distance_, iter_num_, f_smoothness);
+    calcFeasibilityCost(cps_.points, f_feasibility, g_feasibility_);
 
-    f_combine = lambda1_ * f_swarm_attract + lambda1_ * f_smoothness + new_lambda2_ * f_distance + lambda3_ * f_feasibility + new_lambda2_ * f_swarm + lambda2_ * f_terminal;
+    f_combine = problem_->lambda1_ * f_swarm_attract + problem_->lambda1_ * f_smoothness + new_lambda2_ * f_distance + problem_->lambda3_ * f_feasibility + new_lambda2_ * f_swarm + problem_->lambda2_ * f_terminal;
     //f_combine = lambda1_ * f_smoothness + new_lambda2_ * f_distance + lambda3_ * f_feasibility + new_lambda2_ * f_mov_objs;
     //printf("origin %f %f %f %f\n", f_smoothness, f_distance, f_feasibility, f_combine);
 
-    Eigen::MatrixXd grad_3D = lambda1_ * g_swarm_attract + lambda1_ * g_smoothness + new_lambda2_ * g_distance + lambda3_ * g_feasibility + new_lambda2_ * g_swarm + lambda2_ * g_terminal;
+    grad_3D_.noalias() = problem_->lambda1_ * g_swarm_attract_ + problem_->lambda1_ * g_smoothness_ + new_lambda2_ * g_distance_ + problem_->lambda3_ * g_feasibility_ + new_lambda2_ * g_swarm_ + problem_->lambda2_ * g_terminal_;
     //Eigen::MatrixXd grad_3D = lambda1_ * g_smoothness + new_lambda2_ * g_distance + lambda3_ * g_feasibility + new_lambda2_ * g_mov_objs;
-    memcpy(grad, grad_3D.data() + 3 * order_, n * sizeof(grad[0]));
+    memcpy(grad, grad_3D_.data() + 3 * problem_->order_, n * sizeof(grad[0]));
   }
 
   void BsplineOptimizer::combineCostRefine(const double *x, double *grad, double &f_combine, const int n)
   {
 
-    memcpy(cps_.points.data() + 3 * order_, x, n * sizeof(x[0]));
+    memcpy(cps_.points.data() + 3 * problem_->order_, x, n * sizeof(x[0]));
 
     /* ---------- evaluate cost and gradient ---------- */
     double f_smoothness, f_fitness, f_feasibility;
 
-    Eigen::MatrixXd g_smoothness = Eigen::MatrixXd::Zero(3, cps_.points.cols());
-    Eigen::MatrixXd g_fitness = Eigen::MatrixXd::Zero(3, cps_.points.cols());
-    Eigen::MatrixXd g_feasibility = Eigen::MatrixXd::Zero(3, cps_.points.cols());
+    g_smoothness_.setZero(3, cps_.points.cols());
+    g_fitness_.setZero(3, cps_.points.cols());
+    g_feasibility_.setZero(3, cps_.points.cols());
 
     //time_satrt = ros::Time::now();
 
-    calcSmoothnessCost(cps_.points, f_smoothness, g_smoothness);
-    calcFitnessCost(cps_.points, f_fitness, g_fitness);
-    calcFeasibilityCost(cps_.points, f_feasibility, g_feasibility);
+    calcSmoothnessCost(cps_.points, f_smoothness, g_smoothness_);
+    calcFitnessCost(cps_.points, f_fitness, g_fitness_);
+    calcFeasibilityCost(cps_.points, f_feasibility, g_feasibility_);
 
     /* ---------- convert to solver format...---------- */
-    f_combine = lambda1_ * f_smoothness + lambda4_ * f_fitness + lambda3_ * f_feasibility;
+    f_combine = problem_->lambda1_ * f_smoothness + new_lambda4_ * f_fitness + problem_->lambda3_ * f_feasibility;
     // printf("origin %f %f %f %f\n", f_smoothness, f_fitness, f_feasibility, f_combine);
 
-    Eigen::MatrixXd grad_3D = lambda1_ * g_smoothness + lambda4_ * g_fitness + lambda3_ * g_feasibility;
-    memcpy(grad, grad_3D.data() + 3 * order_, n * sizeof(grad[0]));
+    grad_3D_.noalias() = problem_->lambda1_ * g_smoothness_ + new_lambda4_ * g_fitness_ + problem_->lambda3_ * g_feasibility_;
+    memcpy(grad, grad_3D_.data() + 3 * problem_->order_, n * sizeof(grad[0]));
   }
 
   void BsplineOptimizer::initControlPoints_yaw(const Eigen::MatrixXd &yaw_control_points)
@@ -1854,18 +1996,18 @@ namespace ego_planner
   bool BsplineOptimizer::rebound_optimize_yaw()
   {
     iter_num_ = 0;
-    int start_id = order_;
+    int start_id = problem_->order_;
     int end_id = this->cps_yaw_.points.cols(); // Free end
-    variable_num_ = (order_ + 1) * (end_id - start_id);
-    int pos_cps_num = (order_) * (end_id - start_id);
+    variable_num_ = (problem_->order_ + 1) * (end_id - start_id);
+    int pos_cps_num = (problem_->order_) * (end_id - start_id);
 
     double q[variable_num_];
     double final_cost;
 
-    memcpy(q, cps_.points.data() + 3 * order_, pos_cps_num * sizeof(q[0]));
-    for( int i = 0; i < ((int)cps_yaw_.points.cols() - order_); i++)
+    memcpy(q, cps_.points.data() + 3 * problem_->order_, pos_cps_num * sizeof(q[0]));
+    for( int i = 0; i < ((int)cps_yaw_.points.cols() - problem_->order_); i++)
     {
-      q[i + pos_cps_num] = cps_yaw_.points(0, i + order_);
+      q[i + pos_cps_num] = cps_yaw_.points(0, i + problem_->order_);
     }
 
     // 1. 确定要吸引的点和对应的飞机
@@ -1879,23 +2021,23 @@ namespace ego_planner
 
     int end_id_tracking = end_id * 4 / 4;
     std::vector<int> visibility_inflate( end_id_tracking, 0 );
-    for( int i = order_; i < end_id_tracking; i++)
+    for( int i = problem_->order_; i < end_id_tracking; i++)
     {
-      double glb_time = t_now + ((double)(order_ - 1) / 2 + (i - order_ + 1)) * bspline_interval_;
+      double glb_time = t_now + ((double)(problem_->order_ - 1) / 2 + (i - problem_->order_ + 1)) * bspline_interval_;
       size_t id = 1;
       {
-        double traj_i_satrt_time = swarm_trajs_->at(id).start_time_.toSec();
-        if (glb_time < traj_i_satrt_time + swarm_trajs_->at(id).duration_ - 0.1)
+        double traj_i_satrt_time = problem_->swarm_trajs_->at(id).start_time_.toSec();
+        if (glb_time < traj_i_satrt_time + problem_->swarm_trajs_->at(id).duration_ - 0.1)
         {
           // 1. 优化前确定对应关系
-          Eigen::Vector3d swarm_prid = swarm_trajs_->at(id).position_traj_.evaluateDeBoorT(glb_time - traj_i_satrt_time);
+          Eigen::Vector3d swarm_prid = problem_->swarm_trajs_->at(id).position_traj_.evaluateFixedT<3, 3>(glb_time - traj_i_satrt_time);
           Eigen::Vector3d drone_pos = cps_.points.col(i);
           Eigen::Vector3d dist_vec = drone_pos - swarm_prid;
           attract_pts_.push_back(i);
           attract_pts_cor_drone_.push_back(swarm_prid);
 
           // 2. visibility
-          if(!grid_map_->isInESDF(drone_pos) || !grid_map_->isInESDF(swarm_prid))
+          if(!problem_->grid_map_->isInESDF(drone_pos) || !problem_->grid_map_->isInESDF(swarm_prid))
             continue;
 
           // 过一遍visibility的计算
@@ -1909,7 +2051,7 @@ namespace ego_planner
             Eigen::Vector3d pk = lambda_k * drone_pos + ( 1- lambda_k ) * swarm_prid;
             double threshold_k = dist_threshold * ( 1- lambda_k ) * line_norm;
             double dist_visibility;
-            grid_map_->evaluateESDF(pk, dist_visibility);
+            problem_->grid_map_->evaluateESDF(pk, dist_visibility);
             if( dist_visibility < dist_threshold )
             {
               visibility_index.push_back(i);
@@ -1928,7 +2070,7 @@ namespace ego_planner
       }
     }
 
-    for( int i = order_; i < end_id_tracking; i++)
+    for( int i = problem_->order_; i < end_id_tracking; i++)
     {
       if( visibility_inflate[i] == 0 )
         safe_yaw_index.push_back(i);
@@ -1988,66 +2130,65 @@ namespace ego_planner
   void BsplineOptimizer::combineCostReboundYaw(const double *x, double *grad, double &f_combine, const int n)
   {
     int pos_cps_num = n * 3 / 4;
-    memcpy(cps_.points.data() + 3 * order_, x, pos_cps_num * sizeof(x[0]));
+    memcpy(cps_.points.data() + 3 * problem_->order_, x, pos_cps_num * sizeof(x[0]));
     for( int i = 0; i < n/4; i++)
     {
-      cps_yaw_.points(0, i + order_) = x[i + pos_cps_num];
+      cps_yaw_.points(0, i + problem_->order_) = x[i + pos_cps_num];
     }
     
 
     /* ---------- calculate ---------- */
     /* ---------- pos :::: cost and gradient ---------- */
     double f_smoothness, f_esdf, f_feasibility, f_tracking_dist;
-    Eigen::MatrixXd g_smoothness = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_esdf = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_feasibility = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_tracking_dist = Eigen::MatrixXd::Zero(3, cps_.size);
-    Eigen::MatrixXd g_swarm_attract = Eigen::MatrixXd::Zero(3, cps_.size);
-    calcSmoothnessCost(cps_.points, f_smoothness, g_smoothness);
-    calcESDFReboundCost(cps_.points, f_esdf, g_esdf);
-    calcFeasibilityCost(cps_.points, f_feasibility, g_feasibility);
-    calcTrackingDistanceCost(cps_.points, f_tracking_dist, g_tracking_dist);
+    g_smoothness_.setZero(3, cps_.size);
+    g_esdf_.setZero(3, cps_.size);
+    g_feasibility_.setZero(3, cps_.size);
+    g_tracking_dist_.setZero(3, cps_.size);
+    calcSmoothnessCost(cps_.points, f_smoothness, g_smoothness_);
+    calcESDFReboundCost(cps_.points, f_esdf, g_esdf_);
+    calcFeasibilityCost(cps_.points, f_feasibility, g_feasibility_);
+    calcTrackingDistanceCost(cps_.points, f_tracking_dist, g_tracking_dist_);
     /* ---------- visibility  :::: cost and gradient ---------- */
     double f_visibility = 0;
-    Eigen::MatrixXd g_visibility = Eigen::MatrixXd::Zero(3, cps_.size);
-    calcVisibilityReboundCost( cps_.points, f_visibility, g_visibility );
+    g_visibility_.setZero(3, cps_.size);
+    calcVisibilityReboundCost( cps_.points, f_visibility, g_visibility_ );
     /* ---------- yaw  :::: cost and gradient ---------- */
     double f_smoothness_yaw, f_feasibility_yaw, f_safe_yaw;
-    Eigen::MatrixXd g_smoothness_yaw = Eigen::MatrixXd::Zero(1, cps_yaw_.size);
-    Eigen::MatrixXd g_feasibility_yaw = Eigen::MatrixXd::Zero(1, cps_yaw_.size);
-    Eigen::MatrixXd g_safe_yaw = Eigen::MatrixXd::Zero(1, cps_yaw_.size);
-    calcSmoothnessCost_yaw(cps_yaw_.points.row(0), f_smoothness_yaw, g_smoothness_yaw);
-    calcFeasibilityCost_yaw(cps_yaw_.points.row(0), f_feasibility_yaw, g_feasibility_yaw);
-    calcSafeCost_yaw(cps_yaw_.points.row(0), f_safe_yaw, g_safe_yaw);
+    g_smoothness_yaw_.setZero(1, cps_yaw_.size);
+    g_feasibility_yaw_.setZero(1, cps_yaw_.size);
+    g_safe_yaw_.setZero(1, cps_yaw_.size);
+    calcSmoothnessCost_yaw(cps_yaw_.points.row(0), f_smoothness_yaw, g_smoothness_yaw_);
+    calcFeasibilityCost_yaw(cps_yaw_.points.row(0), f_feasibility_yaw, g_feasibility_yaw_);
+    calcSafeCost_yaw(cps_yaw_.points.row(0), f_safe_yaw, g_safe_yaw_);
     
     /* ---------- swarm pos and yaw  :::: cost and gradient ---------- */
     double f_tracking_yaw_and_pos;
-    Eigen::MatrixXd g_tracking_yaw = Eigen::MatrixXd::Zero(1, cps_yaw_.size);
-    Eigen::MatrixXd g_tracking_pos = Eigen::MatrixXd::Zero(3, cps_yaw_.size);
-    calcTrackingYawAndPosCost(cps_.points, cps_yaw_.points.row(0), f_tracking_yaw_and_pos, g_tracking_yaw, g_tracking_pos);
+    g_tracking_yaw_.setZero(1, cps_yaw_.size);
+    g_tracking_pos_.setZero(3, cps_yaw_.size);
+    calcTrackingYawAndPosCost(cps_.points, cps_yaw_.points.row(0), f_tracking_yaw_and_pos, g_tracking_yaw_, g_tracking_pos_);
 
 
     /* ---------- combine ---------- */
     // pos: visibility; smoothness; esdf; feasibility; tracking_dist
-    f_combine = tracking_lambda_visibility_ * f_visibility + tracking_lambda_smooth_ * f_smoothness + tracking_lambda_esdf_ * f_esdf + 
-                tracking_lambda_feasibility_ * f_feasibility + tracking_lambda_tracking_dist_ * f_tracking_dist;
-    Eigen::MatrixXd grad_3D = tracking_lambda_visibility_ * g_visibility + tracking_lambda_smooth_ * g_smoothness + tracking_lambda_esdf_ * g_esdf + 
-                tracking_lambda_feasibility_ * g_feasibility + tracking_lambda_tracking_dist_ * g_tracking_dist;
+    f_combine = problem_->tracking_lambda_visibility_ * f_visibility + problem_->tracking_lambda_smooth_ * f_smoothness + problem_->tracking_lambda_esdf_ * f_esdf + 
+                problem_->tracking_lambda_feasibility_ * f_feasibility + problem_->tracking_lambda_tracking_dist_ * f_tracking_dist;
+    grad_3D_.noalias() = problem_->tracking_lambda_visibility_ * g_visibility_ + problem_->tracking_lambda_smooth_ * g_smoothness_ + problem_->tracking_lambda_esdf_ * g_esdf_ + 
+                problem_->tracking_lambda_feasibility_ * g_feasibility_ + problem_->tracking_lambda_tracking_dist_ * g_tracking_dist_;
     // yaw: smoothness; feasibility
-    f_combine += tracking_lambda_smoothness_yaw_ * f_smoothness_yaw + tracking_lambda_feasibility_yaw_ * f_feasibility_yaw + 
-                tracking_lambda_safe_yaw_ * f_safe_yaw;
-    Eigen::MatrixXd grad_yaw_temp = tracking_lambda_smoothness_yaw_ * g_smoothness_yaw + tracking_lambda_feasibility_yaw_ * g_feasibility_yaw + 
-                tracking_lambda_safe_yaw_ * g_safe_yaw;     
+    f_combine += problem_->tracking_lambda_smoothness_yaw_ * f_smoothness_yaw + problem_->tracking_lambda_feasibility_yaw_ * f_feasibility_yaw + 
+                problem_->tracking_lambda_safe_yaw_ * f_safe_yaw;
+    grad_yaw_.noalias() = problem_->tracking_lambda_smoothness_yaw_ * g_smoothness_yaw_ + problem_->tracking_lambda_feasibility_yaw_ * g_feasibility_yaw_ + 
+                problem_->tracking_lambda_safe_yaw_ * g_safe_yaw_;     
     // tracking: pos and yaw
-    f_combine += tracking_lambda_tracking_yaw_and_pos_ * f_tracking_yaw_and_pos;
-    grad_3D += tracking_lambda_tracking_yaw_and_pos_ * g_tracking_pos;
-    grad_yaw_temp += tracking_lambda_tracking_yaw_and_pos_ * g_tracking_yaw;
+    f_combine += problem_->tracking_lambda_tracking_yaw_and_pos_ * f_tracking_yaw_and_pos;
+    grad_3D_ += problem_->tracking_lambda_tracking_yaw_and_pos_ * g_tracking_pos_;
+    grad_yaw_ += problem_->tracking_lambda_tracking_yaw_and_pos_ * g_tracking_yaw_;
 
 
-    memcpy(grad, grad_3D.data() + 3 * order_, pos_cps_num * sizeof(grad[0]));
-    for( int i = 0; i < (int)grad_yaw_temp.size() - order_; i++)
+    memcpy(grad, grad_3D_.data() + 3 * problem_->order_, pos_cps_num * sizeof(grad[0]));
+    for( int i = 0; i < (int)grad_yaw_.size() - problem_->order_; i++)
     {
-      grad[i + pos_cps_num] = grad_yaw_temp(0, i + order_);
+      grad[i + pos_cps_num] = grad_yaw_(0, i + problem_->order_);
     }
   }
 
@@ -2121,7 +2262,7 @@ namespace ego_planner
     {
       int i = safe_yaw_index[i_safe_yaw];
       double yaw_now = q(i);
-      double yaw_error = yaw_now - target_vel_yaw_;
+      double yaw_error = yaw_now - problem_->target_vel_yaw_;
 
       double lambda = 1.0;
       if( i < 8 )
@@ -2135,8 +2276,8 @@ namespace ego_planner
   void BsplineOptimizer::calcTrackingDistanceCost(const Eigen::MatrixXd &q, double &cost, Eigen::MatrixXd &gradient)
   {
     cost = 0.0;
-    double min_dist_threshold = best_attract_min_dist_;
-    double max_dist_threshold = best_attract_max_dist_;
+    double min_dist_threshold = problem_->best_attract_min_dist_;
+    double max_dist_threshold = problem_->best_attract_max_dist_;
 
     for(size_t i_attract = 0; i_attract < attract_pts_.size(); i_attract++)
     {
@@ -2196,8 +2337,8 @@ namespace ego_planner
       Eigen::Vector3d yaw_vec_raw = swarm_prid - cps_.points.col(i);
       Eigen::Vector3d yaw_vec = yaw_vec_raw;
 
-      yaw_vec(0) = yaw_vec_raw(0) * init_yaw_cos_ - yaw_vec_raw(1) * init_yaw_sin_;
-      yaw_vec(1) = yaw_vec_raw(0) * init_yaw_sin_ + yaw_vec_raw(1) * init_yaw_cos_;
+      yaw_vec(0) = yaw_vec_raw(0) * problem_->init_yaw_cos_ - yaw_vec_raw(1) * problem_->init_yaw_sin_;
+      yaw_vec(1) = yaw_vec_raw(0) * problem_->init_yaw_sin_ + yaw_vec_raw(1) * problem_->init_yaw_cos_;
 
       double yaw_best = atan2( yaw_vec(1), yaw_vec(0) );
       double yaw_now = q_yaw(i);
@@ -2209,8 +2350,8 @@ namespace ego_planner
       double result = yaw_vec(1) * yaw_vec(1) + yaw_vec(0) * yaw_vec(0);
       double result_x = -yaw_vec(1) / result;
       double result_y =  yaw_vec(0) / result;
-      gradient_pos(0, i) += d_yaw * 2 * ( result_x * init_yaw_cos_ + result_y * init_yaw_sin_ );
-      gradient_pos(1, i) += d_yaw * 2 * (-result_x * init_yaw_sin_ + result_y * init_yaw_cos_ );
+      gradient_pos(0, i) += d_yaw * 2 * ( result_x * problem_->init_yaw_cos_ + result_y * problem_->init_yaw_sin_ );
+      gradient_pos(1, i) += d_yaw * 2 * (-result_x * problem_->init_yaw_sin_ + result_y * problem_->init_yaw_cos_ );
     }
   }
 
@@ -2220,20 +2361,23 @@ namespace ego_planner
   {
     cost = 0.0;
     double dist_threshold = 0.8;
-    double          dist;
-    Eigen::Vector3d dist_grad;
+
+    if (q.cols() <= 3)
+      return;
+
+    esdf_batch_pts_ = q.rightCols(q.cols() - 3);
+    problem_->grid_map_->evaluateESDFWithGradBatch(esdf_batch_pts_, esdf_batch_dist_, esdf_batch_grad_, esdf_batch_valid_);
 
     for (int i = 3; i < q.cols(); i++)
     {
-      if( !grid_map_->evaluateESDFWithGrad(q.col(i), dist, dist_grad) )
+      if( !esdf_batch_valid_(i - 3) )
         continue;
 
+      double dist = esdf_batch_dist_(i - 3);
       if( dist < dist_threshold )
       {
         cost += pow(dist - dist_threshold, 2);
-        gradient(0, i) += 2.0 * (dist - dist_threshold) * dist_grad(0);
-        gradient(1, i) += 2.0 * (dist - dist_threshold) * dist_grad(1);
-        gradient(2, i) += 2.0 * (dist - dist_threshold) * dist_grad(2);
+        gradient.col(i) += 2.0 * (dist - dist_threshold) * esdf_batch_grad_.col(i - 3);
       }
     }
   }
@@ -2252,6 +2396,25 @@ vis_pk_grad.clear();
 vis_pk_grad_real.clear();
 vis_pk.clear();
 
+    const int sample = 10;
+
+    // all samples of all segments go through a single batched esdf query
+    esdf_batch_pts_.resize(3, visibility_index.size() * sample);
+    for(size_t i_attract = 0; i_attract < visibility_index.size(); i_attract++)
+    {
+      Eigen::Vector3d swarm_pos = visibility_target_point[i_attract];
+      Eigen::Vector3d now_pos = cps_.points.col(visibility_index[i_attract]);
+      for( int kk = 1; kk <= sample; kk++ )
+      {
+        double lambda_k = kk * 1.0 / sample;
+        esdf_batch_pts_.col(i_attract * sample + kk - 1) = lambda_k * now_pos + ( 1- lambda_k ) * swarm_pos;
+      }
+    }
+    problem_->grid_map_->evaluateESDFWithGradBatch(esdf_batch_pts_, esdf_batch_dist_, esdf_batch_grad_, esdf_batch_valid_);
+
+    dist = 0.0;
+    dist_grad.setZero();
+
     for(size_t i_attract = 0; i_attract < visibility_index.size(); i_attract++)
     {
       int i = visibility_index[i_attract];
@@ -2260,17 +2423,22 @@ vis_pk.clear();
       
       Eigen::Vector3d visibility_grad{0, 0, 0};
 
-      int sample = 10;
       double dist_threshold = 1.0;
       double line_norm = ( now_pos - swarm_pos ).norm();
 
       for( int kk = 1; kk <= sample; kk++ )
       {
         double lambda_k = kk * 1.0 / sample;
-        Eigen::Vector3d pk = lambda_k * now_pos + ( 1- lambda_k ) * swarm_pos;
+        int k = i_attract * sample + kk - 1;
+        Eigen::Vector3d pk = esdf_batch_pts_.col(k);
         double threshold_k = dist_threshold * ( 1- lambda_k ) * line_norm;
 
-        grid_map_->evaluateESDFWithGrad(pk, dist, dist_grad);
+        // points outside the esdf keep the previous sample's value, as the single queries did
+        if (esdf_batch_valid_(k))
+        {
+          dist = esdf_batch_dist_(k);
+          dist_grad = esdf_batch_grad_.col(k);
+        }
         if (dist_grad.norm() > 1e-4) dist_grad.normalize();
 
         if( dist < threshold_k )
@@ -1,4 +1,5 @@
 #include "bspline_opt/uniform_bspline.h"
+#include <traj_utils/banded_cholesky.h>
 #include <ros/ros.h>
 
 namespace ego_planner
@@ -39,9 +40,43 @@ namespace ego_planner
         u_(i) = u_(i - 1) + interval_;
       }
     }
+
+    updateKnotSpan();
+  }
+
+  void UniformBspline::setKnot(const Eigen::VectorXd &knot)
+  {
+    this->u_ = knot;
+    updateKnotSpan();
+  }
+
+  void UniformBspline::updateKnotSpan()
+  {
+    uniform_knots_ = false;
+    if (u_.rows() <= p_ + 1)
+      return;
+
+    knot_span_ = u_(p_ + 1) - u_(p_);
+    uniform_knots_ = knot_span_ > 0;
+    for (int i = 1; i < u_.rows() && uniform_knots_; ++i)
+      if (fabs(u_(i) - u_(i - 1) - knot_span_) > 1e-6 * knot_span_)
+        uniform_knots_ = false;
   }
 
-  void UniformBspline::setKnot(const Eigen::VectorXd &knot) { this->u_ = knot; }
+  // the k with u_(k) < ub <= u_(k+1), k in [p, m-p-1], as found by scanning from u_(p)
+  int UniformBspline::findSpan(const double &ub)
+  {
+    if (!uniform_knots_)
+      return std::lower_bound(u_.data() + p_ + 1, u_.data() + m_ - p_ + 1, ub) - u_.data() - 1;
+
+    int k = p_ + (int)floor((ub - u_(p_)) / knot_span_);
+    k = min(max(k, p_), m_ - p_ - 1);
+    if (k > p_ && u_(k) >= ub)
+      --k;
+    else if (k < m_ - p_ - 1 && u_(k + 1) < ub)
+      ++k;
+    return k;
+  }
 
   Eigen::VectorXd UniformBspline::getKnot() { return this->u_; }
 
@@ -61,24 +96,16 @@ namespace ego_planner
   Eigen::VectorXd UniformBspline::evaluateDeBoor(const double &u)
   {
 
+    if (p_ == 3 && control_points_.rows() == 3)
+      return evaluateFixed<3, 3>(u);
+
     double ub = min(max(u_(p_), u), u_(m_ - p_));
 
     // determine which [ui,ui+1] lay in
-    int k = p_;
-    while (true)
-    {
-      if (u_(k + 1) >= ub)
-        break;
-      ++k;
-    }
+    int k = findSpan(ub);
 
     /* deBoor's alg */
-    vector<Eigen::VectorXd> d;
-    for (int i = 0; i <= p_; ++i)
-    {
-      d.push_back(control_points_.col(k - p_ + i));
-      // cout << d[i].transpose() << endl;
-    }
+    Eigen::MatrixXd d = control_points_.block(0, k - p_, control_points_.rows(), p_ + 1);
 
     for (int r = 1; r <= p_; ++r)
     {
@@ -86,11 +113,11 @@ namespace ego_planner
       {
         double alpha = (ub - u_[i + k - p_]) / (u_[i + 1 + k - r] - u_[i + k - p_]);
         // cout << "alpha: " << alpha << endl;
-        d[i] = (1 - alpha) * d[i - 1] + alpha * d[i];
+        d.col(i) = (1 - alpha) * d.col(i - 1) + alpha * d.col(i);
       }
     }
 
-    return d[p_];
+    return d.col(p_);
   }
 
   // Eigen::VectorXd UniformBspline::evaluateDeBoorT(const double& t) {
@@ -204,80 +231,91 @@ namespace ego_planner
       u_(i) += double(i - num1) * t_inc;
     for (int i = num2 + 1; i < u_.rows(); ++i)
       u_(i) += delta_t;
+
+    updateKnotSpan();
   }
 
   // void UniformBspline::recomputeInit() {}
 
-  void UniformBspline::parameterizeToBspline(const double &ts, const vector<Eigen::Vector3d> &point_set,
+  bool UniformBspline::parameterizeToBspline(const double &ts, const vector<Eigen::Vector3d> &point_set,
                                              const vector<Eigen::Vector3d> &start_end_derivative,
                                              Eigen::MatrixXd &ctrl_pts)
   {
     if (ts <= 0)
     {
       cout << "[B-spline]:time step error." << endl;
-      return;
+      return false;
     }
 
     if (point_set.size() <= 3)
     {
       cout << "[B-spline]:point set have only " << point_set.size() << " points." << endl;
-      return;
+      return false;
     }
 
     if (start_end_derivative.size() != 4)
     {
       cout << "[B-spline]:derivatives error." << endl;
+      return false;
     }
 
     int K = point_set.size();
 
-    // write A
+    // write A, row r only touches control points col[r] .. col[r] + 2
     Eigen::Vector3d prow(3), vrow(3), arow(3);
     prow << 1, 4, 1;
     vrow << -1, 0, 1;
     arow << 1, -2, 1;
 
-    Eigen::MatrixXd A = Eigen::MatrixXd::Zero(K + 4, K + 2);
-
+    Eigen::MatrixXd A_rows(K + 4, 3);
+    Eigen::VectorXi col(K + 4);
     for (int i = 0; i < K; ++i)
-      A.block(i, i, 1, 3) = (1 / 6.0) * prow.transpose();
+    {
+      A_rows.row(i) = (1 / 6.0) * prow.transpose();
+      col(i) = i;
+    }
 
-    A.block(K, 0, 1, 3) = (1 / 2.0 / ts) * vrow.transpose();
-    A.block(K + 1, K - 1, 1, 3) = (1 / 2.0 / ts) * vrow.transpose();
+    A_rows.row(K) = (1 / 2.0 / ts) * vrow.transpose();
+    A_rows.row(K + 1) = (1 / 2.0 / ts) * vrow.transpose();
+    A_rows.row(K + 2) = (1 / ts / ts) * arow.transpose();
+    A_rows.row(K + 3) = (1 / ts / ts) * arow.transpose();
+    col(K) = col(K + 2) = 0;
+    col(K + 1) = col(K + 3) = K - 1;
 
-    A.block(K + 2, 0, 1, 3) = (1 / ts / ts) * arow.transpose();
-    A.block(K + 3, K - 1, 1, 3) = (1 / ts / ts) * arow.transpose();
+    // write b, one column per axis
+    Eigen::MatrixXd b(K + 4, 3);
+    for (int i = 0; i < K; ++i)
+      b.row(i) = point_set[i].transpose();
 
-    //cout << "A" << endl << A << endl << endl;
+    for (int i = 0; i < 4; ++i)
+      b.row(K + i) = start_end_derivative[i].transpose();
 
-    // write b
-    Eigen::VectorXd bx(K + 4), by(K + 4), bz(K + 4);
-    for (int i = 0; i < K; ++i)
+    // least squares A x = b through the normal equations A^T A x = A^T b,
+    // A^T A is pentadiagonal so all three axes cost O(K)
+    BandedCholesky AtA(K + 2, 2);
+    Eigen::MatrixXd Atb = Eigen::MatrixXd::Zero(K + 2, 3);
+    for (int r = 0; r < K + 4; ++r)
     {
-      bx(i) = point_set[i](0);
-      by(i) = point_set[i](1);
-      bz(i) = point_set[i](2);
+      for (int i = 0; i < 3; ++i)
+      {
+        Atb.row(col(r) + i) += A_rows(r, i) * b.row(r);
+        for (int j = 0; j <= i; ++j)
+          AtA(col(r) + i, col(r) + j) += A_rows(r, i) * A_rows(r, j);
+      }
     }
 
-    for (int i = 0; i < 4; ++i)
+    if (!AtA.factorize())
     {
-      bx(K + i) = start_end_derivative[i](0);
-      by(K + i) = start_end_derivative[i](1);
-      bz(K + i) = start_end_derivative[i](2);
+      cout << "[B-spline]:parameterization is singular." << endl;
+      return false;
     }
-
-    // solve Ax = b
-    Eigen::VectorXd px = A.colPivHouseholderQr().solve(bx);
-    Eigen::VectorXd py = A.colPivHouseholderQr().solve(by);
-    Eigen::VectorXd pz = A.colPivHouseholderQr().solve(bz);
+    AtA.solveInPlace(Atb);
 
     // convert to control pts
-    ctrl_pts.resize(3, K + 2);
-    ctrl_pts.row(0) = px.transpose();
-    ctrl_pts.row(1) = py.transpose();
-    ctrl_pts.row(2) = pz.transpose();
+    ctrl_pts = Atb.transpose();
 
     // cout << "[B-spline]: parameterization ok." << endl;
+    return true;
   }
 
   double UniformBspline::getTimeSum()
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <bspline_opt/bspline_optimizer.h>
+
+using namespace ego_planner;
+
+namespace
+{
+
+void setParams(ros::NodeHandle &nh)
+{
+  nh.setParam("grid_map/resolution", 0.1);
+  nh.setParam("grid_map/map_size_x", 10.0);
+  nh.setParam("grid_map/map_size_y", 10.0);
+  nh.setParam("grid_map/map_size_z", 3.0);
+  nh.setParam("grid_map/local_update_range_x", 5.5);
+  nh.setParam("grid_map/local_update_range_y", 5.5);
+  nh.setParam("grid_map/local_update_range_z", 4.5);
+  nh.setParam("grid_map/obstacles_inflation", 0.099);
+  nh.setParam("grid_map/ground_height", -0.01);
+
+  nh.setParam("optimization/lambda_smooth", 5.0);
+  nh.setParam("optimization/lambda_collision", 0.5);
+  nh.setParam("optimization/lambda_feasibility", 0.1);
+  nh.setParam("optimization/lambda_fitness", 1.0);
+  nh.setParam("optimization/dist0", 0.2);
+  nh.setParam("optimization/swarm_clearance", 0.5);
+  nh.setParam("optimization/max_vel", 2.0);
+  nh.setParam("optimization/max_acc", 3.0);
+}
+
+void setBox(GridMap &map, const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max)
+{
+  const double res = map.getResolution();
+  for (double x = box_min(0); x <= box_max(0); x += res)
+    for (double y = box_min(1); y <= box_max(1); y += res)
+      for (double z = box_min(2); z <= box_max(2); z += res)
+        map.setOccupied(Eigen::Vector3d(x, y, z));
+}
+
+BsplineOptimizer::Ptr makeOptimizer(const BsplineProblem::ConstPtr &problem, const GridMap::Ptr &map)
+{
+  BsplineOptimizer::Ptr opt(new BsplineOptimizer(problem));
+  opt->a_star_.reset(new AStar);
+  opt->a_star_->initGridMap(map, Eigen::Vector3i(100, 100, 100));
+  return opt;
+}
+
+}  // namespace
+
+TEST(BsplineOptimizerTest, CandidatesDoNotDependOnThreadCount)
+{
+  ros::NodeHandle nh("~");
+  setParams(nh);
+
+  GridMap::Ptr map(new GridMap);
+  map->initMap(nh);
+  map->setCameraPosition(Eigen::Vector3d(0.05, 0.05, 1.05));
+  // two walls across the checked first 2/3 of a straight path, so there are two colliding segments and four candidates
+  setBox(*map, Eigen::Vector3d(-1.5, -0.3, 0.0), Eigen::Vector3d(-1.3, 0.4, 2.5));
+  setBox(*map, Eigen::Vector3d(0.3, -0.4, 0.0), Eigen::Vector3d(0.5, 0.3, 2.5));
+  map->updateESDF();
+
+  static SwarmTrajData swarm_trajs;
+  BsplineOptimizer::Ptr planner = makeOptimizer(BsplineProblem::ConstPtr(new BsplineProblem), map);
+  planner->setParam(nh);
+  planner->setEnvironment(map);
+  planner->setSwarmTrajs(&swarm_trajs);
+  planner->setDroneId(0);
+  planner->setLocalTargetPt(Eigen::Vector3d(3.5, 0.0, 1.0));
+
+  const double ts = 0.2;
+  const int num = 21;
+  Eigen::MatrixXd init_points(3, num);
+  for (int i = 0; i < num; ++i)
+    init_points.col(i) = Eigen::Vector3d(-3.5 + 7.0 * i / (num - 1), 0.0, 1.0);
+  std::vector<std::pair<int, int>> segments = planner->initControlPoints(init_points, true);
+  std::vector<ControlPoints> trajs = planner->distinctiveTrajs(segments);
+  ASSERT_GE(trajs.size(), 3u);
+
+  // without the bound, with the default ratio and with a ratio that stops every other candidate
+  int unbounded_best = -1;
+  for (double cost_ratio : {0.0, 2.0, 1.05})
+  {
+    std::vector<Eigen::MatrixXd> serial_pts, pool_pts;
+    std::vector<double> serial_cost, pool_cost;
+    std::vector<char> serial_success, pool_success;
+
+    BsplineOptimizer::optimizeCandidates({planner.get()}, NULL, trajs, ts, cost_ratio, serial_pts, serial_cost,
+                                         serial_success);
+
+    int best = -1;
+    for (size_t i = 0; i < trajs.size(); ++i)
+      if (serial_success[i] && (best < 0 || serial_cost[i] < serial_cost[best]))
+        best = i;
+    ASSERT_GE(best, 0);
+    if (cost_ratio == 0.0)
+      unbounded_best = best;
+    // the cheapest candidate is slower to converge than the first one, the default bound must not stop it
+    else if (cost_ratio == 2.0)
+      EXPECT_EQ(best, unbounded_best);
+
+    for (int threads = 2; threads <= 4; ++threads)
+    {
+      ThreadPool pool(threads);
+      std::vector<BsplineOptimizer::Ptr> optimizers;
+      std::vector<BsplineOptimizer *> optimizer_ptrs;
+      for (int i = 0; i < threads; ++i)
+      {
+        optimizers.push_back(makeOptimizer(planner->getProblem(), map));
+        optimizer_ptrs.push_back(optimizers.back().get());
+      }
+
+      BsplineOptimizer::optimizeCandidates(optimizer_ptrs, &pool, trajs, ts, cost_ratio, pool_pts, pool_cost,
+                                           pool_success);
+
+      for (size_t i = 0; i < trajs.size(); ++i)
+      {
+        EXPECT_EQ(serial_success[i], pool_success[i]) << "candidate " << i << ", " << threads << " threads";
+        if (serial_success[i] && pool_success[i])
+        {
+          EXPECT_EQ(serial_cost[i], pool_cost[i]) << "candidate " << i << ", " << threads << " threads";
+          EXPECT_TRUE(serial_pts[i] == pool_pts[i]) << "candidate " << i << ", " << threads << " threads";
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_bspline_optimizer");
+  return RUN_ALL_TESTS();
+}
@@ -6,7 +6,10 @@
 #include <ros/console.h>
 #include <Eigen/Eigen>
 #include <plan_env/grid_map.h>
-#include <queue>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
 
 constexpr double inf = 1 >> 20;
 struct GridNode;
@@ -30,19 +33,93 @@ struct GridNode
 
 	double gScore{inf}, fScore{inf};
 	GridNodePtr cameFrom{NULL};
+	int heap_pos{-1}; // slot in the open set while state == OPENSET
 };
 
-class NodeComparator
+// 4-ary min-heap on fScore. Nodes remember their slot, so a lowered fScore is sifted up in place
+// instead of pushing a duplicate.
+class NodeHeap
 {
 public:
-	bool operator()(GridNodePtr node1, GridNodePtr node2)
+	void clear() { heap_.clear(); }
+	bool empty() const { return heap_.empty(); }
+	size_t size() const { return heap_.size(); }
+	GridNodePtr top() const { return heap_[0]; }
+
+	void push(GridNodePtr node)
 	{
-		return node1->fScore > node2->fScore;
+		heap_.push_back(node);
+		siftUp(heap_.size() - 1);
 	}
+
+	void pop()
+	{
+		GridNodePtr last = heap_.back();
+		heap_.pop_back();
+		if (!heap_.empty())
+		{
+			heap_[0] = last;
+			siftDown(0);
+		}
+	}
+
+	void decreaseKey(GridNodePtr node) { siftUp(node->heap_pos); }
+
+private:
+	static constexpr int ARITY = 4;
+
+	void siftUp(int i)
+	{
+		GridNodePtr node = heap_[i];
+		while (i > 0)
+		{
+			int parent = (i - 1) / ARITY;
+			if (heap_[parent]->fScore <= node->fScore)
+				break;
+			heap_[i] = heap_[parent];
+			heap_[i]->heap_pos = i;
+			i = parent;
+		}
+		heap_[i] = node;
+		node->heap_pos = i;
+	}
+
+	void siftDown(int i)
+	{
+		GridNodePtr node = heap_[i];
+		const int n = heap_.size();
+		while (true)
+		{
+			int first = ARITY * i + 1;
+			if (first >= n)
+				break;
+			int best = first;
+			for (int c = first + 1; c < std::min(first + ARITY, n); ++c)
+				if (heap_[c]->fScore < heap_[best]->fScore)
+					best = c;
+			if (heap_[best]->fScore >= node->fScore)
+				break;
+			heap_[i] = heap_[best];
+			heap_[i]->heap_pos = i;
+			i = best;
+		}
+		heap_[i] = node;
+		node->heap_pos = i;
+	}
+
+	std::vector<GridNodePtr> heap_;
 };
 
 class AStar
 {
+public:
+	enum SearchMode
+	{
+		GRAPH_SEARCH = 0,      // plain 26-connected A*
+		JUMP_POINT_SEARCH = 1, // 3D JPS jumping along the axes, the path is densified back to grid steps
+		BIDIRECTIONAL = 2      // A* from both ends, meeting in the middle
+	};
+
 private:
 	GridMap::Ptr grid_map_;
 
@@ -64,15 +141,58 @@ private:
 
 	std::vector<GridNodePtr> retrievePath(GridNodePtr current);
 
+	bool searchGraph(GridNodePtr startPtr, GridNodePtr endPtr, const ros::Time &time_1);
+	bool searchJPS(GridNodePtr startPtr, GridNodePtr endPtr, const ros::Time &time_1);
+	bool searchBidirectional(GridNodePtr startPtr, GridNodePtr endPtr, const ros::Time &time_1);
+	void expandBidirectional(GridNodePtr current, std::vector<GridNode> &pool, NodeHeap &open_set, GridNodePtr target,
+							 const std::vector<GridNode> &other_pool, double &best_cost, int &meet_idx);
+
+	/* jump point search */
+	// the 3x3x3 neighbourhood is addressed by (dx+1)*9 + (dy+1)*3 + (dz+1), the center is 13
+	static inline int dirId(const Eigen::Vector3i &d) { return (d(0) + 1) * 9 + (d(1) + 1) * 3 + (d(2) + 1); }
+	static inline Eigen::Vector3i dirOf(int id) { return Eigen::Vector3i(id / 9 - 1, id / 3 % 3 - 1, id % 3 - 1); }
+	inline bool isFreeCell(const Eigen::Vector3i &idx);
+	uint32_t occupancyAround(const Eigen::Vector3i &idx, uint32_t cells = (1u << 27) - 1); // bits of the occupied ones among cells
+	static uint32_t jpsSuccessors(int dir_id, uint32_t occ_mask);
+	bool jump(const Eigen::Vector3i &from, int dir_id, const Eigen::Vector3i &goal, Eigen::Vector3i &jump_point);
+
+	// pruning rules of each direction, built once from the alternative paths inside the neighbourhood
+	struct JpsRules
+	{
+		uint32_t natural[27];                      // neighbours kept in free space
+		uint32_t forcing[27];                      // cells whose occupancy can force a neighbour
+		uint32_t scanned[27];                      // cells a jump looks at, the forcing ones and what they force
+		std::vector<uint32_t> prune_paths[27][27]; // cells of each path that prunes the neighbour while free
+	};
+	static const JpsRules &jpsRules();
+
+	std::vector<unsigned int> occ_stamp_; // (rounds_ << 1) | occupied, JPS only
+
 	double step_size_, inv_step_size_;
 	Eigen::Vector3d center_;
 	Eigen::Vector3i CENTER_IDX_, POOL_SIZE_;
 	const double tie_breaker_ = 1.0 + 1.0 / 10000;
+	const int jps_max_jump_ = 4; // a straight jump also stops here, longer ones scan more cells than they save nodes (astar_benchmark)
 
 	std::vector<GridNodePtr> gridPath_;
 
-	GridNodePtr ***GridNodeMap_;
-	std::priority_queue<GridNodePtr, std::vector<GridNodePtr>, NodeComparator> openSet_;
+	// one contiguous pool, nodes of earlier searches are recognized by their rounds and reset lazily
+	std::vector<GridNode> node_pool_;
+	NodeHeap openSet_;
+
+	// backward half of the bidirectional search, allocated only in that mode
+	std::vector<GridNode> node_pool_bwd_;
+	NodeHeap openSet_bwd_;
+
+	int search_mode_{GRAPH_SEARCH};
+	int num_expanded_{0};
+
+	inline int flatIndex(const Eigen::Vector3i &idx) const { return (idx(0) * POOL_SIZE_(1) + idx(1)) * POOL_SIZE_(2) + idx(2); }
+	inline GridNodePtr getNode(const Eigen::Vector3i &idx) { return &node_pool_[flatIndex(idx)]; }
+	inline bool insidePool(const Eigen::Vector3i &idx) const
+	{
+		return idx(0) >= 1 && idx(0) < POOL_SIZE_(0) - 1 && idx(1) >= 1 && idx(1) < POOL_SIZE_(1) - 1 && idx(2) >= 1 && idx(2) < POOL_SIZE_(2) - 1;
+	}
 
 	int rounds_{0};
 
@@ -80,13 +200,17 @@ public:
 	typedef std::shared_ptr<AStar> Ptr;
 
 	AStar(){};
-	~AStar();
+	~AStar(){};
 
 	void initGridMap(GridMap::Ptr occ_map, const Eigen::Vector3i pool_size);
 
+	void setSearchMode(int mode);
+	int getSearchMode() const { return search_mode_; }
+
 	bool AstarSearch(const double step_size, Eigen::Vector3d start_pt, Eigen::Vector3d end_pt);
 
 	std::vector<Eigen::Vector3d> getPath();
+	int getNumExpanded() const { return num_expanded_; } // nodes expanded by the last search
 };
 
 inline double AStar::getHeu(GridNodePtr node1, GridNodePtr node2)
@@ -94,6 +218,17 @@ inline double AStar::getHeu(GridNodePtr node1, GridNodePtr node2)
 	return tie_breaker_ * getDiagHeu(node1, node2);
 }
 
+inline bool AStar::isFreeCell(const Eigen::Vector3i &idx)
+{
+	if (!insidePool(idx))
+		return false;
+
+	unsigned int &stamp = occ_stamp_[flatIndex(idx)];
+	if ((int)(stamp >> 1) != rounds_)
+		stamp = ((unsigned int)rounds_ << 1) | (unsigned int)checkOccupancy(Index2Coord(idx));
+	return !(stamp & 1);
+}
+
 inline Eigen::Vector3d AStar::Index2Coord(const Eigen::Vector3i &index) const
 {
 	return ((index - CENTER_IDX_).cast<double>() * step_size_) + center_;
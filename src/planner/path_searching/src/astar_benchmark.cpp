@@ -0,0 +1,146 @@
+#include <ros/ros.h>
+#include <ros/topic.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <path_searching/dyn_a_star.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+/* Compares the search modes of AStar (manager/astar_search_mode: 0 graph search, 1 jump point search,
+   2 bidirectional) on a mockamap map. The map is the first cloud received on ~map, the grid map is
+   configured by the usual grid_map/ parameters, see launch/astar_benchmark.launch. Every mode solves
+   the same random start and goal pairs with its own AStar, sized like the one of the planner. */
+
+struct ModeResult
+{
+  int success{0};
+  double time_sum{0}, expanded_sum{0};
+  vector<double> times, lengths;
+};
+
+double pathLength(const vector<Eigen::Vector3d> &path)
+{
+  double len = 0;
+  for (size_t i = 1; i < path.size(); ++i)
+    len += (path[i] - path[i - 1]).norm();
+  return len;
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "astar_benchmark");
+  ros::NodeHandle nh("~");
+
+  int queries, seed, pool_size;
+  double min_dist, max_dist, step_size, inflation;
+  nh.param("benchmark/queries", queries, 200);
+  nh.param("benchmark/seed", seed, 1);
+  nh.param("benchmark/min_dist", min_dist, 2.0);
+  nh.param("benchmark/max_dist", max_dist, 8.0);
+  nh.param("benchmark/step_size", step_size, 0.1);
+  nh.param("benchmark/pool_size", pool_size, 100);
+  nh.param("grid_map/obstacles_inflation", inflation, 0.099);
+
+  GridMap::Ptr grid_map(new GridMap);
+  grid_map->initMap(nh);
+
+  sensor_msgs::PointCloud2ConstPtr msg = ros::topic::waitForMessage<sensor_msgs::PointCloud2>("map", nh, ros::Duration(10.0));
+  if (!msg)
+  {
+    ROS_ERROR("astar_benchmark: no map received on %s/map", nh.getNamespace().c_str());
+    return 1;
+  }
+
+  /* inflate the cloud into the occupancy the searches query, as the planner sees it */
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  pcl::fromROSMsg(*msg, cloud);
+  const double res = grid_map->getResolution();
+  const int inf_step = ceil(inflation / res);
+  for (const pcl::PointXYZ &pt : cloud.points)
+    for (int x = -inf_step; x <= inf_step; ++x)
+      for (int y = -inf_step; y <= inf_step; ++y)
+        for (int z = -inf_step; z <= inf_step; ++z)
+          grid_map->setOccupied(Eigen::Vector3d(pt.x + x * res, pt.y + y * res, pt.z + z * res));
+
+  /* start and goal pairs in free space, close enough for the node pool around their middle */
+  Eigen::Vector3d origin, size;
+  grid_map->getRegion(origin, size);
+  default_random_engine eng(seed);
+  uniform_real_distribution<double> rand_unit(0.0, 1.0);
+  const double max_extent = (pool_size / 2 - 1) * step_size * 2;
+
+  vector<pair<Eigen::Vector3d, Eigen::Vector3d>> pairs;
+  for (int tries = 0; (int)pairs.size() < queries && tries < 1000 * queries; ++tries)
+  {
+    Eigen::Vector3d start, goal;
+    for (int k = 0; k < 3; ++k)
+    {
+      start(k) = origin(k) + size(k) * rand_unit(eng);
+      goal(k) = origin(k) + size(k) * rand_unit(eng);
+    }
+    double dist = (goal - start).norm();
+    if (dist < min_dist || dist > max_dist || (goal - start).cwiseAbs().maxCoeff() > max_extent ||
+        grid_map->getInflateOccupancy(start) != 0 || grid_map->getInflateOccupancy(goal) != 0)
+      continue;
+    pairs.emplace_back(start, goal);
+  }
+
+  const char *names[] = {"graph search", "jump point search", "bidirectional"};
+  vector<ModeResult> results(3);
+  for (int mode = 0; mode < 3; ++mode)
+  {
+    AStar astar;
+    astar.initGridMap(grid_map, Eigen::Vector3i(pool_size, pool_size, pool_size));
+    astar.setSearchMode(mode);
+
+    ModeResult &r = results[mode];
+    for (const auto &query : pairs)
+    {
+      ros::WallTime t1 = ros::WallTime::now();
+      bool success = astar.AstarSearch(step_size, query.first, query.second);
+      double t = (ros::WallTime::now() - t1).toSec();
+
+      r.times.push_back(t);
+      r.time_sum += t;
+      r.expanded_sum += astar.getNumExpanded();
+      r.lengths.push_back(success ? pathLength(astar.getPath()) : -1.0);
+      r.success += success;
+    }
+  }
+
+  ROS_INFO("astar_benchmark: %d queries, %.1f to %.1f m, %zu map points", (int)pairs.size(), min_dist, max_dist,
+           cloud.points.size());
+  for (int mode = 0; mode < 3; ++mode)
+  {
+    ModeResult &r = results[mode];
+    vector<double> sorted = r.times;
+    sort(sorted.begin(), sorted.end());
+
+    // path lengths relative to the graph search, over the queries both solved
+    double excess_sum = 0, excess_max = 0;
+    int both = 0;
+    for (size_t i = 0; i < pairs.size(); ++i)
+      if (r.lengths[i] >= 0 && results[0].lengths[i] >= 0)
+      {
+        double excess = r.lengths[i] / max(results[0].lengths[i], 1e-9) - 1.0;
+        excess_sum += excess;
+        excess_max = max(excess_max, excess);
+        both++;
+      }
+
+    ROS_INFO("astar_benchmark: mode %d (%s): success %d/%d, mean %.3f ms, median %.3f ms, expanded %.0f, "
+             "length vs mode 0 %+.2f%% mean %+.2f%% max",
+             mode, names[mode], r.success, (int)pairs.size(), r.time_sum / max((int)pairs.size(), 1) * 1e3,
+             sorted.empty() ? 0.0 : sorted[sorted.size() / 2] * 1e3, r.expanded_sum / max((int)pairs.size(), 1),
+             both ? excess_sum / both * 100 : 0.0, excess_max * 100);
+  }
+
+  return 0;
+}
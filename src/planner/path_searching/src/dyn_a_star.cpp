@@ -1,36 +1,34 @@
 #include "path_searching/dyn_a_star.h"
+#include <functional>
 
 using namespace std;
 using namespace Eigen;
 
-AStar::~AStar()
-{
-    for (int i = 0; i < POOL_SIZE_(0); i++)
-        for (int j = 0; j < POOL_SIZE_(1); j++)
-            for (int k = 0; k < POOL_SIZE_(2); k++)
-                delete GridNodeMap_[i][j][k];
-}
-
 void AStar::initGridMap(GridMap::Ptr occ_map, const Eigen::Vector3i pool_size)
 {
     POOL_SIZE_ = pool_size;
     CENTER_IDX_ = pool_size / 2;
 
-    GridNodeMap_ = new GridNodePtr **[POOL_SIZE_(0)];
-    for (int i = 0; i < POOL_SIZE_(0); i++)
+    node_pool_.assign(POOL_SIZE_.prod(), GridNode());
+
+    grid_map_ = occ_map;
+
+    setSearchMode(search_mode_); // resize the buffers of the current mode
+}
+
+void AStar::setSearchMode(int mode)
+{
+    if (mode < GRAPH_SEARCH || mode > BIDIRECTIONAL)
     {
-        GridNodeMap_[i] = new GridNodePtr *[POOL_SIZE_(1)];
-        for (int j = 0; j < POOL_SIZE_(1); j++)
-        {
-            GridNodeMap_[i][j] = new GridNodePtr[POOL_SIZE_(2)];
-            for (int k = 0; k < POOL_SIZE_(2); k++)
-            {
-                GridNodeMap_[i][j][k] = new GridNode;
-            }
-        }
+        ROS_ERROR("Unknown A star search mode %d, use the 26-connected graph search.", mode);
+        mode = GRAPH_SEARCH;
     }
+    search_mode_ = mode;
 
-    grid_map_ = occ_map;
+    if (search_mode_ == JUMP_POINT_SEARCH && occ_stamp_.size() != node_pool_.size())
+        occ_stamp_.assign(node_pool_.size(), 0);
+    if (search_mode_ == BIDIRECTIONAL && node_pool_bwd_.size() != node_pool_.size())
+        node_pool_bwd_.assign(node_pool_.size(), GridNode());
 }
 
 double AStar::getDiagHeu(GridNodePtr node1, GridNodePtr node2)
@@ -137,16 +135,41 @@ bool AStar::AstarSearch(const double step_size, Vector3d start_pt, Vector3d end_
     // if ( start_pt(0) > -1 && start_pt(0) < 0 )
     //     cout << "start_pt=" << start_pt.transpose() << " end_pt=" << end_pt.transpose() << endl;
 
-    GridNodePtr startPtr = GridNodeMap_[start_idx(0)][start_idx(1)][start_idx(2)];
-    GridNodePtr endPtr = GridNodeMap_[end_idx(0)][end_idx(1)][end_idx(2)];
+    GridNodePtr startPtr = getNode(start_idx);
+    GridNodePtr endPtr = getNode(end_idx);
+
+    startPtr->index = start_idx;
+    endPtr->index = end_idx;
+    num_expanded_ = 0;
+
+    bool success;
+    switch (search_mode_)
+    {
+    case JUMP_POINT_SEARCH:
+        success = searchJPS(startPtr, endPtr, time_1);
+        break;
+    case BIDIRECTIONAL:
+        success = searchBidirectional(startPtr, endPtr, time_1);
+        break;
+    default:
+        success = searchGraph(startPtr, endPtr, time_1);
+        break;
+    }
+
+    double t_search = (ros::Time::now() - time_1).toSec();
+    if (!success && t_search > 0.1 && t_search <= 0.2) // longer searches already reported the time limit
+        ROS_WARN("Time consume in A star path finding is %.3fs, iter=%d", t_search, num_expanded_);
+
+    return success;
+}
 
-    std::priority_queue<GridNodePtr, std::vector<GridNodePtr>, NodeComparator> empty;
-    openSet_.swap(empty);
+bool AStar::searchGraph(GridNodePtr startPtr, GridNodePtr endPtr, const ros::Time &time_1)
+{
+    openSet_.clear();
 
     GridNodePtr neighborPtr = NULL;
     GridNodePtr current = NULL;
 
-    startPtr->index = start_idx;
     startPtr->rounds = rounds_;
     startPtr->gScore = 0;
     startPtr->fScore = getHeu(startPtr, endPtr);
@@ -154,14 +177,11 @@ bool AStar::AstarSearch(const double step_size, Vector3d start_pt, Vector3d end_
     startPtr->cameFrom = NULL;
     openSet_.push(startPtr); //put start in open set
 
-    endPtr->index = end_idx;
-
     double tentative_gScore;
 
-    int num_iter = 0;
     while (!openSet_.empty())
     {
-        num_iter++;
+        num_expanded_++;
         current = openSet_.top();
         openSet_.pop();
 
@@ -191,13 +211,12 @@ bool AStar::AstarSearch(const double step_size, Vector3d start_pt, Vector3d end_
                     neighborIdx(1) = (current->index)(1) + dy;
                     neighborIdx(2) = (current->index)(2) + dz;
 
-                    if (neighborIdx(0) < 1 || neighborIdx(0) >= POOL_SIZE_(0) - 1 || neighborIdx(1) < 1 || neighborIdx(1) >= POOL_SIZE_(1) - 1 || neighborIdx(2) < 1 || neighborIdx(2) >= POOL_SIZE_(2) - 1)
+                    if (!insidePool(neighborIdx))
                     {
                         continue;
                     }
 
-                    neighborPtr = GridNodeMap_[neighborIdx(0)][neighborIdx(1)][neighborIdx(2)];
-                    neighborPtr->index = neighborIdx;
+                    neighborPtr = getNode(neighborIdx);
 
                     bool flag_explored = neighborPtr->rounds == rounds_;
 
@@ -206,11 +225,16 @@ bool AStar::AstarSearch(const double step_size, Vector3d start_pt, Vector3d end_
                         continue; //in closed set.
                     }
 
-                    neighborPtr->rounds = rounds_;
-
-                    if (checkOccupancy(Index2Coord(neighborPtr->index)))
+                    if (!flag_explored)
                     {
-                        continue;
+                        neighborPtr->index = neighborIdx;
+                        neighborPtr->rounds = rounds_;
+
+                        if (checkOccupancy(Index2Coord(neighborPtr->index)))
+                        {
+                            neighborPtr->state = GridNode::CLOSEDSET; // never expanded, and not checked again
+                            continue;
+                        }
                     }
 
                     double static_cost = sqrt(dx * dx + dy * dy + dz * dz);
@@ -230,6 +254,7 @@ bool AStar::AstarSearch(const double step_size, Vector3d start_pt, Vector3d end_
                         neighborPtr->cameFrom = current;
                         neighborPtr->gScore = tentative_gScore;
                         neighborPtr->fScore = tentative_gScore + getHeu(neighborPtr, endPtr);
+                        openSet_.decreaseKey(neighborPtr);
                     }
                 }
         ros::Time time_2 = ros::Time::now();
@@ -240,20 +265,402 @@ bool AStar::AstarSearch(const double step_size, Vector3d start_pt, Vector3d end_
         }
     }
 
-    ros::Time time_2 = ros::Time::now();
+    return false;
+}
 
-    if ((time_2 - time_1).toSec() > 0.1)
-        ROS_WARN("Time consume in A star path finding is %.3fs, iter=%d", (time_2 - time_1).toSec(), num_iter);
+uint32_t AStar::occupancyAround(const Vector3i &idx, uint32_t cells)
+{
+    cells &= ~(1u << 13);
+    uint32_t occ_mask = 0;
+    const Vector3i lo = idx - Vector3i::Ones(), hi = idx + Vector3i::Ones();
+    if (!insidePool(lo) || !insidePool(hi))
+    {
+        for (uint32_t rest = cells; rest; rest &= rest - 1)
+        {
+            int id = __builtin_ctz(rest);
+            if (!isFreeCell(idx + dirOf(id)))
+                occ_mask |= 1u << id;
+        }
+        return occ_mask;
+    }
+
+    // the whole neighbourhood is inside the pool, walk it by flat offsets
+    const int center = flatIndex(idx);
+    const int sy = POOL_SIZE_(2), sx = POOL_SIZE_(1) * POOL_SIZE_(2);
+    for (uint32_t rest = cells; rest; rest &= rest - 1)
+    {
+        int id = __builtin_ctz(rest);
+        int dx = id / 9 - 1, dy = id / 3 % 3 - 1, dz = id % 3 - 1;
+
+        unsigned int &stamp = occ_stamp_[center + dx * sx + dy * sy + dz];
+        if ((int)(stamp >> 1) != rounds_)
+            stamp = ((unsigned int)rounds_ << 1) | (unsigned int)checkOccupancy(Index2Coord(idx + Vector3i(dx, dy, dz)));
+        occ_mask |= (stamp & 1) << id;
+    }
+
+    return occ_mask;
+}
+
+const AStar::JpsRules &AStar::jpsRules()
+{
+    /* Node x was entered along d from p = x - d. A free neighbour n of x is pruned if the 3x3x3
+       neighbourhood holds a free path p -> n avoiding x that is shorter than p -> x -> n, or as long and
+       canonical (its moves ordered from the most to the least diagonal). Such paths have at most three
+       moves, so they are listed once per direction, and n is forced exactly when each of them is blocked. */
+    static const JpsRules rules = [] {
+        JpsRules r;
+        const double eps = 1e-6;
+        for (int dir_id = 0; dir_id < 27; dir_id++)
+        {
+            r.natural[dir_id] = r.forcing[dir_id] = r.scanned[dir_id] = 0;
+            if (dir_id == 13)
+                continue;
+
+            const double d_len = dirOf(dir_id).cast<double>().norm();
+            const int parent = 26 - dir_id; // cell of -d
+            std::vector<uint32_t> paths[27];
+            paths[parent].push_back(0); // never step back
+
+            // depth first over the cells visited after p, mask holds the ones before the current cell
+            std::function<void(const Vector3i &, double, int, bool, uint32_t)> extend =
+                [&](const Vector3i &cell, double len, int last_nnz, bool canonical, uint32_t mask) {
+                    for (int m = 0; m < 27; m++)
+                    {
+                        Vector3i move = dirOf(m);
+                        Vector3i next = cell + move;
+                        if (m == 13 || next.cwiseAbs().maxCoeff() > 1 || next == Vector3i::Zero())
+                            continue;
+
+                        int nnz = move.cwiseAbs().sum();
+                        double next_len = len + sqrt((double)nnz);
+                        if (next_len > d_len + sqrt(3.0) + eps) // longer than any p -> x -> n
+                            continue;
+
+                        int next_id = dirId(next);
+                        bool next_canonical = canonical && nnz <= last_nnz;
+                        double via_x = d_len + next.cast<double>().norm();
+                        if (next_len < via_x - eps || (next_canonical && next_len <= via_x + eps))
+                            paths[next_id].push_back(mask);
+
+                        extend(next, next_len, nnz, next_canonical, mask | 1u << next_id);
+                    }
+                };
+            extend(dirOf(parent), 0.0, 3, true, 0);
+
+            for (int n = 0; n < 27; n++)
+            {
+                if (n == 13)
+                    continue;
+                if (paths[n].empty())
+                {
+                    r.natural[dir_id] |= 1u << n;
+                    continue;
+                }
+
+                // a path through a subset of the cells of another one makes the longer path redundant
+                std::vector<uint32_t> &list = paths[n];
+                std::sort(list.begin(), list.end(), [](uint32_t a, uint32_t b) { return __builtin_popcount(a) < __builtin_popcount(b); });
+                if (list.front() == 0) // pruned whatever is occupied
+                    continue;
+
+                std::vector<uint32_t> &kept = r.prune_paths[dir_id][n];
+                for (uint32_t mask : list)
+                    if (std::none_of(kept.begin(), kept.end(), [mask](uint32_t k) { return (k & mask) == k; }))
+                    {
+                        kept.push_back(mask);
+                        r.forcing[dir_id] |= mask;
+                    }
+                r.scanned[dir_id] |= 1u << n;
+            }
+            r.scanned[dir_id] |= r.forcing[dir_id];
+        }
+        return r;
+    }();
+
+    return rules;
+}
+
+uint32_t AStar::jpsSuccessors(int dir_id, uint32_t occ_mask)
+{
+    const JpsRules &rules = jpsRules();
+    uint32_t successors = rules.natural[dir_id] & ~occ_mask;
+    if (!(occ_mask & rules.forcing[dir_id]))
+        return successors;
+
+    for (int n = 0; n < 27; n++)
+    {
+        const std::vector<uint32_t> &paths = rules.prune_paths[dir_id][n];
+        if (paths.empty() || (occ_mask >> n & 1))
+            continue;
+
+        bool forced = true;
+        for (uint32_t mask : paths)
+            forced = forced && (mask & occ_mask);
+        if (forced)
+            successors |= 1u << n;
+    }
+
+    return successors;
+}
+
+bool AStar::jump(const Vector3i &from, int dir_id, const Vector3i &goal, Vector3i &jump_point)
+{
+    const Vector3i d = dirOf(dir_id);
+    const JpsRules &rules = jpsRules();
+
+    // a diagonal jump stops at its first cell, deciding whether to go on takes a jump along each of its
+    // sub-directions, which the node repeats when it is expanded
+    const int max_steps = d.cwiseAbs().sum() > 1 ? 1 : jps_max_jump_;
+
+    Vector3i cur = from;
+    for (int step = 1;; step++)
+    {
+        cur += d;
+        if (!isFreeCell(cur))
+            return false;
+
+        if (cur == goal || step >= max_steps)
+            break;
+
+        uint32_t occ_mask = occupancyAround(cur, rules.scanned[dir_id]);
+        if (occ_mask != 0 && (jpsSuccessors(dir_id, occ_mask) & ~rules.natural[dir_id])) // has a forced neighbour
+            break;
+    }
+
+    jump_point = cur;
+    return true;
+}
+
+bool AStar::searchJPS(GridNodePtr startPtr, GridNodePtr endPtr, const ros::Time &time_1)
+{
+    openSet_.clear();
+
+    startPtr->rounds = rounds_;
+    startPtr->gScore = 0;
+    startPtr->fScore = getHeu(startPtr, endPtr);
+    startPtr->state = GridNode::OPENSET;
+    startPtr->cameFrom = NULL;
+    openSet_.push(startPtr);
+
+    while (!openSet_.empty())
+    {
+        num_expanded_++;
+        GridNodePtr current = openSet_.top();
+        openSet_.pop();
+
+        if (current == endPtr)
+        {
+            gridPath_ = retrievePath(current);
+            return true;
+        }
+        current->state = GridNode::CLOSEDSET;
+
+        uint32_t successors;
+        if (current->cameFrom == NULL) // the start node tries every direction
+            successors = ~occupancyAround(current->index) & ((1u << 27) - 1) & ~(1u << 13);
+        else
+            successors = jpsSuccessors(dirId((current->index - current->cameFrom->index).cwiseSign()), occupancyAround(current->index));
+
+        for (int dir_id = 0; dir_id < 27; dir_id++)
+        {
+            Vector3i jump_point;
+            if (!(successors >> dir_id & 1) || !jump(current->index, dir_id, endPtr->index, jump_point))
+                continue;
+
+            GridNodePtr neighborPtr = getNode(jump_point);
+
+            bool flag_explored = neighborPtr->rounds == rounds_;
+
+            if (flag_explored && neighborPtr->state == GridNode::CLOSEDSET)
+                continue;
+
+            // the jump point lies on the straight grid line from current along dir
+            double tentative_gScore = current->gScore + (jump_point - current->index).cwiseAbs().maxCoeff() * dirOf(dir_id).cast<double>().norm();
+
+            if (!flag_explored)
+            {
+                neighborPtr->index = jump_point;
+                neighborPtr->rounds = rounds_;
+                neighborPtr->state = GridNode::OPENSET;
+                neighborPtr->cameFrom = current;
+                neighborPtr->gScore = tentative_gScore;
+                neighborPtr->fScore = tentative_gScore + getHeu(neighborPtr, endPtr);
+                openSet_.push(neighborPtr);
+            }
+            else if (tentative_gScore < neighborPtr->gScore)
+            {
+                neighborPtr->cameFrom = current;
+                neighborPtr->gScore = tentative_gScore;
+                neighborPtr->fScore = tentative_gScore + getHeu(neighborPtr, endPtr);
+                openSet_.decreaseKey(neighborPtr);
+            }
+        }
+
+        ros::Time time_2 = ros::Time::now();
+        if ((time_2 - time_1).toSec() > 0.2)
+        {
+            ROS_WARN("Failed in A star path searching !!! 0.2 seconds time limit exceeded.");
+            return false;
+        }
+    }
 
     return false;
 }
 
+void AStar::expandBidirectional(GridNodePtr current, std::vector<GridNode> &pool, NodeHeap &open_set, GridNodePtr target,
+                                const std::vector<GridNode> &other_pool, double &best_cost, int &meet_idx)
+{
+    current->state = GridNode::CLOSEDSET;
+
+    for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                if (dx == 0 && dy == 0 && dz == 0)
+                    continue;
+
+                Vector3i neighborIdx = current->index + Vector3i(dx, dy, dz);
+                if (!insidePool(neighborIdx))
+                    continue;
+
+                int flat_idx = flatIndex(neighborIdx);
+                GridNodePtr neighborPtr = &pool[flat_idx];
+
+                bool flag_explored = neighborPtr->rounds == rounds_;
+
+                if (flag_explored && neighborPtr->state == GridNode::CLOSEDSET)
+                    continue;
+
+                if (!flag_explored)
+                {
+                    neighborPtr->index = neighborIdx;
+                    neighborPtr->rounds = rounds_;
+
+                    if (checkOccupancy(Index2Coord(neighborPtr->index)))
+                    {
+                        neighborPtr->state = GridNode::CLOSEDSET;
+                        neighborPtr->gScore = std::numeric_limits<double>::infinity(); // never meets the other side
+                        continue;
+                    }
+                }
+
+                double tentative_gScore = current->gScore + sqrt(dx * dx + dy * dy + dz * dz);
+
+                if (!flag_explored)
+                {
+                    neighborPtr->state = GridNode::OPENSET;
+                    neighborPtr->cameFrom = current;
+                    neighborPtr->gScore = tentative_gScore;
+                    neighborPtr->fScore = tentative_gScore + getHeu(neighborPtr, target);
+                    open_set.push(neighborPtr);
+                }
+                else if (tentative_gScore < neighborPtr->gScore)
+                {
+                    neighborPtr->cameFrom = current;
+                    neighborPtr->gScore = tentative_gScore;
+                    neighborPtr->fScore = tentative_gScore + getHeu(neighborPtr, target);
+                    open_set.decreaseKey(neighborPtr);
+                }
+                else
+                    continue;
+
+                // reached by the other side as well, a candidate path through this node
+                const GridNode &other = other_pool[flat_idx];
+                if (other.rounds == rounds_ && tentative_gScore + other.gScore < best_cost)
+                {
+                    best_cost = tentative_gScore + other.gScore;
+                    meet_idx = flat_idx;
+                }
+            }
+}
+
+bool AStar::searchBidirectional(GridNodePtr startPtr, GridNodePtr endPtr, const ros::Time &time_1)
+{
+    if (startPtr == endPtr)
+    {
+        gridPath_.assign(1, startPtr);
+        return true;
+    }
+
+    GridNodePtr goalPtr = &node_pool_bwd_[flatIndex(endPtr->index)]; // the backward search starts at the goal
+
+    openSet_.clear();
+    openSet_bwd_.clear();
+
+    for (GridNodePtr root : {startPtr, goalPtr})
+    {
+        root->rounds = rounds_;
+        root->gScore = 0;
+        root->fScore = getHeu(root, root == startPtr ? endPtr : startPtr);
+        root->state = GridNode::OPENSET;
+        root->cameFrom = NULL;
+    }
+    goalPtr->index = endPtr->index;
+    openSet_.push(startPtr);
+    openSet_bwd_.push(goalPtr);
+
+    double best_cost = std::numeric_limits<double>::infinity();
+    int meet_idx = -1;
+
+    while (!openSet_.empty() && !openSet_bwd_.empty())
+    {
+        // no path through either frontier can beat the best meeting found so far
+        if (max(openSet_.top()->fScore, openSet_bwd_.top()->fScore) >= best_cost)
+            break;
+
+        num_expanded_++;
+        if (openSet_.size() <= openSet_bwd_.size())
+        {
+            GridNodePtr current = openSet_.top();
+            openSet_.pop();
+            expandBidirectional(current, node_pool_, openSet_, endPtr, node_pool_bwd_, best_cost, meet_idx);
+        }
+        else
+        {
+            GridNodePtr current = openSet_bwd_.top();
+            openSet_bwd_.pop();
+            expandBidirectional(current, node_pool_bwd_, openSet_bwd_, startPtr, node_pool_, best_cost, meet_idx);
+        }
+
+        ros::Time time_2 = ros::Time::now();
+        if ((time_2 - time_1).toSec() > 0.2)
+        {
+            ROS_WARN("Failed in A star path searching !!! 0.2 seconds time limit exceeded.");
+            return false;
+        }
+    }
+
+    if (meet_idx < 0)
+        return false;
+
+    // gridPath_ runs from the goal to the start
+    gridPath_.clear();
+    for (GridNodePtr node = node_pool_bwd_[meet_idx].cameFrom; node != NULL; node = node->cameFrom)
+        gridPath_.push_back(node);
+    reverse(gridPath_.begin(), gridPath_.end());
+    vector<GridNodePtr> forward_path = retrievePath(&node_pool_[meet_idx]);
+    gridPath_.insert(gridPath_.end(), forward_path.begin(), forward_path.end());
+
+    return true;
+}
+
 vector<Vector3d> AStar::getPath()
 {
     vector<Vector3d> path;
 
-    for (auto ptr : gridPath_)
-        path.push_back(Index2Coord(ptr->index));
+    // consecutive nodes are joined by a straight grid line, longer than one step between jump points
+    for (size_t i = 0; i < gridPath_.size(); i++)
+    {
+        Vector3i idx = gridPath_[i]->index;
+        path.push_back(Index2Coord(idx));
+        if (i + 1 == gridPath_.size())
+            break;
+
+        const Vector3i &next = gridPath_[i + 1]->index;
+        Vector3i step = (next - idx).cwiseSign();
+        for (idx += step; idx != next; idx += step)
+            path.push_back(Index2Coord(idx));
+    }
 
     reverse(path.begin(), path.end());
     return path;
@@ -3,9 +3,11 @@
 
 #include <Eigen/Eigen>
 #include <Eigen/StdVector>
+#include <cstdint>
 #include <cv_bridge/cv_bridge.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <nav_msgs/Odometry.h>
 #include <queue>
@@ -16,6 +18,7 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 
 #include <message_filters/subscriber.h>
 #include <message_filters/sync_policies/approximate_time.h>
@@ -23,9 +26,35 @@
 #include <message_filters/time_synchronizer.h>
 
 #include <plan_env/raycast.h>
+#include <plan_env/thread_pool.h>
 
 #define logit(x) (log((x) / (1 - (x))))
 
+// Storage type of the per-voxel log-odds and distance buffers. Set GRID_MAP_FLOAT_STORAGE to 1
+// for the whole workspace to halve their footprint, accessors keep computing in double.
+#ifndef GRID_MAP_FLOAT_STORAGE
+#define GRID_MAP_FLOAT_STORAGE 0
+#endif
+
+#if GRID_MAP_FLOAT_STORAGE
+typedef float GridScalar;
+#else
+typedef double GridScalar;
+#endif
+
+// Voxel layout of the map buffers. Set GRID_MAP_BRICKED_LAYOUT to 1 for the whole workspace to
+// store the grid as 8x8x8 bricks with Morton ordered voxels instead of x-major rows, so that
+// interpolation stencils and inflation kernels stay within a few cache lines.
+#ifndef GRID_MAP_BRICKED_LAYOUT
+#define GRID_MAP_BRICKED_LAYOUT 0
+#endif
+
+// Set GRID_MAP_ROLLING_MAP to 1 for the whole workspace to compile the ring buffer addressing that
+// grid_map/rolling_map needs. Without it the address math has no wraparound and the parameter is ignored.
+#ifndef GRID_MAP_ROLLING_MAP
+#define GRID_MAP_ROLLING_MAP 0
+#endif
+
 using namespace std;
 
 // voxel hashing
@@ -49,6 +78,7 @@ struct MappingParameters {
   Eigen::Vector3d map_origin_, map_size_;
   Eigen::Vector3d map_min_boundary_, map_max_boundary_;  // map range in pos
   Eigen::Vector3i map_voxel_num_;                        // map range in index
+  Eigen::Vector3i map_brick_num_;                        // 8x8x8 bricks per axis, bricked layout only
   Eigen::Vector3d local_update_range_;
   double resolution_, resolution_inv_;
   double obstacles_inflation_;
@@ -85,6 +115,14 @@ struct MappingParameters {
   double unknown_flag_;
 
   int esdf_x_bound_, esdf_y_bound_, esdf_z_bound_;
+  int esdf_threads_;         // scanline workers for the esdf passes, 1 runs serially
+  bool esdf_check_serial_;   // recompute serially after each parallel update and compare
+  bool esdf_incremental_;    // redo only the esdf scanlines that cross changed voxels
+  int esdf_recenter_margin_; // camera drift in voxels before the incremental window is rebuilt
+
+  /* rolling map, the grid is recentered on the camera by whole voxels in x / y */
+  bool rolling_map_;
+  int rolling_margin_;  // camera offset from the grid center in voxels that triggers a shift
 };
 
 // intermediate mapping data for fusion
@@ -92,21 +130,21 @@ struct MappingParameters {
 struct MappingData {
   // main map data, occupancy of each voxel and Euclidean distance
 
-  std::vector<double> occupancy_buffer_;
-  std::vector<char> occupancy_buffer_inflate_;
+  std::vector<GridScalar> occupancy_buffer_;
+  std::vector<uint64_t> occupancy_buffer_inflate_; // one bit per voxel address
 
-  std::vector<double> tmp_buffer1_;
-  std::vector<double> tmp_buffer2_;
-  std::vector<double> distance_buffer_;
-  std::vector<double> distance_buffer_all_;
-  std::vector<double> distance_buffer_neg_;
+  std::vector<GridScalar> tmp_buffer1_;
+  std::vector<GridScalar> tmp_buffer2_;
+  std::vector<GridScalar> distance_buffer_;
+  std::vector<GridScalar> distance_buffer_all_;
+  std::vector<GridScalar> distance_buffer_neg_;
   std::vector<char> occupancy_buffer_neg;
 
-  std::vector<double> freespace_tmp_buffer1_;
-  std::vector<double> freespace_tmp_buffer2_;
-  std::vector<double> freespace_distance_buffer_;
-  std::vector<double> freespace_distance_buffer_all_;
-  std::vector<double> freespace_distance_buffer_neg_;
+  std::vector<GridScalar> freespace_tmp_buffer1_;
+  std::vector<GridScalar> freespace_tmp_buffer2_;
+  std::vector<GridScalar> freespace_distance_buffer_;
+  std::vector<GridScalar> freespace_distance_buffer_all_;
+  std::vector<GridScalar> freespace_distance_buffer_neg_;
   std::vector<char> freespace_occupancy_buffer_neg;
 
   Eigen::Vector3i min_esdf_;
@@ -114,8 +152,21 @@ struct MappingData {
   Eigen::Vector3i freespace_min_esdf_;
   Eigen::Vector3i freespace_max_esdf_;
 
+  // incremental esdf: z and y pass results of the negative layer, kept between updates like
+  // tmp_buffer1_ / tmp_buffer2_ of the positive one, and the (y, z) rows whose x pass is redone
+  std::vector<GridScalar> tmp_buffer_neg1_, tmp_buffer_neg2_;
+  std::vector<char> esdf_row_changed_;
+  Eigen::Vector3i esdf_center_;
+  bool esdf_inc_ready_;
+  // box of occupancy changes not yet reflected in the esdf
+  Eigen::Vector3i esdf_dirty_min_, esdf_dirty_max_;
+  bool esdf_dirty_;
+
   int buffer_size_;
 
+  // x / y index origin of the ring buffer, non-zero only for a rolling map
+  Eigen::Vector3i ring_offset_;
+
   // camera position and pose data
 
   Eigen::Vector3d camera_pos_, last_camera_pos_;
@@ -138,11 +189,15 @@ struct MappingData {
   bool flag_depth_odom_timeout_;
   bool flag_use_depth_fusion;
 
-  // depth image projected point cloud
+  // depth image projected point cloud, one column per axis
 
-  vector<Eigen::Vector3d> proj_points_;
+  Eigen::Matrix<double, Eigen::Dynamic, 3> proj_points_;
   int proj_points_cnt;
 
+  // (u - cx) / fx of the sampled columns and (v - cy) / fy of the sampled rows, a pixel's ray at unit depth
+  Eigen::ArrayXd ray_table_u_, ray_table_v_;
+  int ray_table_cols_, ray_table_rows_;
+
   // flag buffers for speeding up raycasting
 
   vector<short> count_hit_, count_hit_and_miss_;
@@ -171,21 +226,33 @@ public:
 
   // occupancy map management
   void resetBuffer();
+  void rollMap(const Eigen::Vector3d& center);
   void resetBuffer(Eigen::Vector3d min, Eigen::Vector3d max);
 
   inline void posToIndex(const Eigen::Vector3d& pos, Eigen::Vector3i& id);
   inline void indexToPos(const Eigen::Vector3i& id, Eigen::Vector3d& pos);
   inline int toAddress(const Eigen::Vector3i& id);
   inline int toAddress(int& x, int& y, int& z);
+  inline void addressToIndex(int adr, Eigen::Vector3i& id);
+  inline int brickAddress(int x, int y, int z);
   inline bool isInMap(const Eigen::Vector3d& pos);
   inline bool isInMap(const Eigen::Vector3i& idx);
 
   inline void setOccupancy(Eigen::Vector3d pos, double occ = 1);
-  inline void setOccupied(Eigen::Vector3d pos);
+  inline void setOccupied(Eigen::Vector3d pos, bool occ = true);
   inline int getOccupancy(Eigen::Vector3d pos);
   inline int getOccupancy(Eigen::Vector3i id);
   inline int getInflateOccupancy(Eigen::Vector3d pos);
 
+  // The inflated occupancy holds one bit per voxel address, so in the default layout the 64 voxels of
+  // a word are consecutive along z. Segment, column and box queries test whole words, ids must be in map
+  inline bool getInflateBit(int adr);
+  inline void setInflateBit(int adr, bool occ);
+  inline bool isInflateSegmentOccupied(int x, int y, int z_min, int z_max);
+  inline void clearInflateSegment(int x, int y, int z_min, int z_max);
+  inline bool isInflateColumnOccupied(int x, int y);
+  bool isInflateBoxOccupied(const Eigen::Vector3i& min_id, const Eigen::Vector3i& max_id);
+
   inline void boundIndex(Eigen::Vector3i& id);
   inline bool isESDFBound(int& x, int& y, int& z);
   inline bool isESDFBound_for_vis(int& x, int& y, int& z);
@@ -205,6 +272,23 @@ public:
   bool evaluateESDFWithGrad(const Eigen::Vector3d& pos,
                                      double& dist, Eigen::Vector3d& grad);
 
+  // evaluateESDFWithGrad over the columns of pos in one pass. valid(i) is 0 where the single point
+  // query would return false, dist and grad are zero there. Returns the number of valid points.
+  int evaluateESDFWithGradBatch(const Eigen::Ref<const Eigen::Matrix3Xd>& pos, Eigen::VectorXd& dist,
+                                Eigen::Matrix3Xd& grad, Eigen::VectorXi& valid);
+
+  // true only if no inflated obstacle can be inside the ball, judged from the last ESDF update and
+  // the occupancy changes since then. Conservative: false whenever the ESDF cannot tell.
+  bool isBallFree(const Eigen::Vector3d& center, double radius);
+
+  // true if the axis-aligned box is inside the map and no voxel it touches is inflated-occupied
+  bool isBoxFree(const Eigen::Vector3d& min_pos, const Eigen::Vector3d& max_pos);
+
+  // true if no voxel crossed by the segment p1 -> p2 is inflated-occupied or outside the map. Walks
+  // the voxels with a 3D DDA and stops at the first blocked one. With use_esdf, stretches that
+  // isBallFree() proves free are skipped instead of walked.
+  bool isSegmentFree(const Eigen::Vector3d& p1, const Eigen::Vector3d& p2, bool use_esdf = false);
+
   void getSurroundPts(const Eigen::Vector3d& pos, Eigen::Vector3d pts[2][2][2], Eigen::Vector3d& diff);
 
   void getSurroundDistance(Eigen::Vector3d pts[2][2][2], double dists[2][2][2]);
@@ -248,6 +332,11 @@ public:
   int getVoxelNum();
   bool getOdomDepthTimeout() { return md_.flag_depth_odom_timeout_; }
 
+  // drive the map without sensor callbacks, e.g. from benchmarks and tests: the esdf window is
+  // centered on the camera position, updateESDF() runs the update of the esdf timer
+  void setCameraPosition(const Eigen::Vector3d& pos) { md_.camera_pos_ = pos; }
+  void updateESDF();
+
   typedef std::shared_ptr<GridMap> Ptr;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -269,19 +358,32 @@ private:
   void visCallback(const ros::TimerEvent& /*event*/);
   void updateESDFCallback(const ros::TimerEvent& /*event*/);
   void updateFreespaceCallback(const ros::TimerEvent& /*event*/);
-  void updateESDF3d();
+  void updateESDF3d(bool serial = false);
   void updateFreespaceESDF3d();
+  void checkESDFAgainstSerial();
+  void updateESDFIncremental();
+  int updateESDFScanlines(const Eigen::Vector3i& min_dirty, const Eigen::Vector3i& max_dirty);
+  void markESDFDirty(Eigen::Vector3i min_id, Eigen::Vector3i max_id);
 
+  void fillESDF(const double* f, double* d, int* v, double* z, int start, int end);
+  template <typename F_get_val, typename F_set_val>
+  void fillESDFPass(F_get_val f_get_val, F_set_val f_set_val, int dim, bool serial);
   template <typename F_get_val, typename F_set_val>
-  void fillESDF(F_get_val f_get_val, F_set_val f_set_val, int start, int end, int dim);
+  void fillESDFScanline(F_get_val f_get_val, F_set_val f_set_val, Eigen::Vector3i id, int dim, int tid);
+  void runESDFTask(int n, const std::function<void(int, int, int)>& task, bool serial);
 
   // main update process
   void projectDepthImage();
+  void initRayTable(int cols, int rows);
+  int projectDepthRows(int row_begin, int row_end);
   void raycastProcess();
   void clearAndInflateLocalMap();
 
   inline void inflatePoint(const Eigen::Vector3i& pt, int step, vector<Eigen::Vector3i>& pts);
+  inline void dilateAxis(const char* in, char* out, int n, int block, int step, int* count);
+  inline int clampRayEnd(Eigen::Vector3d& pt_w);
   int setCacheOccupancy(Eigen::Vector3d pos, int occ);
+  int setCacheOccupancy(const Eigen::Vector3i& id, int occ);
   Eigen::Vector3d closetPointInMap(const Eigen::Vector3d& pt, const Eigen::Vector3d& camera_pt);
 
   // typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image,
@@ -306,6 +408,25 @@ private:
   ros::Publisher map_pub_, map_inf_pub_, map_freespace_pub_, map_esdf_pub_, visibility_esdf_pub_;
   ros::Timer occ_timer_, ESDF_timer_, vis_timer_, freespace_timer_;
 
+  // per-thread scanline buffers of the esdf passes
+  struct ESDFScratch {
+    vector<double> f, d, z;
+    vector<int> v, adr;
+  };
+  vector<ESDFScratch> esdf_scratch_;
+  unique_ptr<ThreadPool> esdf_pool_;
+
+  // cloud input: voxel offsets a point is inflated by (ascending, so front() / back() are the
+  // extent), and a flag box over the update range that keeps each occupied voxel once per cloud
+  vector<Eigen::Vector3i> inf_stencil_;
+  vector<char> cloud_flag_;
+  Eigen::Vector3i cloud_box_num_;
+  vector<Eigen::Vector3i> cloud_voxels_;
+
+  // occupancy of the local bound and its dilation, over the local bound grown by the inflation
+  vector<char> dilate_buffer1_, dilate_buffer2_;
+  vector<int> dilate_count_;
+
   //
   uniform_real_distribution<double> rand_noise_;
   normal_distribution<double> rand_noise2_;
@@ -315,12 +436,55 @@ private:
 /* ============================== definition of inline function
  * ============================== */
 
+inline int GridMap::brickAddress(int x, int y, int z) {
+  // spreads the three low bits of a brick-local coordinate to every third bit
+  static const int spread[8] = { 0, 1, 8, 9, 64, 65, 72, 73 };
+  int brick = ((x >> 3) * mp_.map_brick_num_(1) + (y >> 3)) * mp_.map_brick_num_(2) + (z >> 3);
+  return (brick << 9) | (spread[x & 7] << 2) | (spread[y & 7] << 1) | spread[z & 7];
+}
+
 inline int GridMap::toAddress(const Eigen::Vector3i& id) {
-  return id(0) * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2) + id(1) * mp_.map_voxel_num_(2) + id(2);
+  int x = id(0), y = id(1), z = id(2);
+  return toAddress(x, y, z);
 }
 
 inline int GridMap::toAddress(int& x, int& y, int& z) {
-  return x * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2) + y * mp_.map_voxel_num_(2) + z;
+#if GRID_MAP_ROLLING_MAP
+  // a rolling map keeps voxels in place and rotates the x / y index origin instead
+  int rx = x + md_.ring_offset_(0), ry = y + md_.ring_offset_(1);
+  if (rx >= mp_.map_voxel_num_(0)) rx -= mp_.map_voxel_num_(0);
+  if (ry >= mp_.map_voxel_num_(1)) ry -= mp_.map_voxel_num_(1);
+#else
+  int rx = x, ry = y;
+#endif
+
+#if GRID_MAP_BRICKED_LAYOUT
+  return brickAddress(rx, ry, z);
+#else
+  return rx * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2) + ry * mp_.map_voxel_num_(2) + z;
+#endif
+}
+
+inline void GridMap::addressToIndex(int adr, Eigen::Vector3i& id) {
+#if GRID_MAP_BRICKED_LAYOUT
+  int m = adr & 511, brick = adr >> 9;
+  id(2) = (brick % mp_.map_brick_num_(2)) * 8 + ((m & 1) | ((m >> 2) & 2) | ((m >> 4) & 4));
+  brick /= mp_.map_brick_num_(2);
+  id(1) = (brick % mp_.map_brick_num_(1)) * 8 + (((m >> 1) & 1) | ((m >> 3) & 2) | ((m >> 5) & 4));
+  id(0) = (brick / mp_.map_brick_num_(1)) * 8 + (((m >> 2) & 1) | ((m >> 4) & 2) | ((m >> 6) & 4));
+#else
+  id(2) = adr % mp_.map_voxel_num_(2);
+  adr /= mp_.map_voxel_num_(2);
+  id(1) = adr % mp_.map_voxel_num_(1);
+  id(0) = adr / mp_.map_voxel_num_(1);
+#endif
+
+#if GRID_MAP_ROLLING_MAP
+  for (int i = 0; i < 2; ++i) {
+    id(i) -= md_.ring_offset_(i);
+    if (id(i) < 0) id(i) += mp_.map_voxel_num_(i);
+  }
+#endif
 }
 
 inline void GridMap::boundIndex(Eigen::Vector3i& id) {
@@ -375,7 +539,7 @@ inline bool GridMap::isKnownFree(const Eigen::Vector3i& id) {
 
   // return md_.occupancy_buffer_[adr] >= mp_.clamp_min_log_ &&
   //     md_.occupancy_buffer_[adr] < mp_.min_occupancy_log_;
-  return md_.occupancy_buffer_[adr] >= mp_.clamp_min_log_ && md_.occupancy_buffer_inflate_[adr] == 0;
+  return md_.occupancy_buffer_[adr] >= (GridScalar)mp_.clamp_min_log_ && !getInflateBit(adr);
 }
 
 inline bool GridMap::isKnownOccupied(const Eigen::Vector3i& id) {
@@ -383,7 +547,7 @@ inline bool GridMap::isKnownOccupied(const Eigen::Vector3i& id) {
   boundIndex(id1);
   int adr = toAddress(id1);
 
-  return md_.occupancy_buffer_inflate_[adr] == 1;
+  return getInflateBit(adr);
 }
 
 inline bool GridMap::isKnownOccupied(const Eigen::Vector3d& pos) {
@@ -393,17 +557,17 @@ inline bool GridMap::isKnownOccupied(const Eigen::Vector3d& pos) {
   boundIndex(idc);
   int adr = toAddress(idc);
 
-  return md_.occupancy_buffer_inflate_[adr] == 1;
+  return getInflateBit(adr);
 }
 
-inline void GridMap::setOccupied(Eigen::Vector3d pos) {
+inline void GridMap::setOccupied(Eigen::Vector3d pos, bool occ) {
   if (!isInMap(pos)) return;
 
   Eigen::Vector3i id;
   posToIndex(pos, id);
 
-  md_.occupancy_buffer_inflate_[id(0) * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2) +
-                                id(1) * mp_.map_voxel_num_(2) + id(2)] = 1;
+  setInflateBit(toAddress(id), occ);
+  markESDFDirty(id, id);
 }
 
 inline void GridMap::setOccupancy(Eigen::Vector3d pos, double occ) {
@@ -471,7 +635,62 @@ inline int GridMap::getInflateOccupancy(Eigen::Vector3d pos) {
   Eigen::Vector3i id;
   posToIndex(pos, id);
 
-  return int(md_.occupancy_buffer_inflate_[toAddress(id)]);
+  return int(getInflateBit(toAddress(id)));
+}
+
+inline bool GridMap::getInflateBit(int adr) {
+  return (md_.occupancy_buffer_inflate_[adr >> 6] >> (adr & 63)) & 1;
+}
+
+inline void GridMap::setInflateBit(int adr, bool occ) {
+  uint64_t bit = uint64_t(1) << (adr & 63);
+  if (occ)
+    md_.occupancy_buffer_inflate_[adr >> 6] |= bit;
+  else
+    md_.occupancy_buffer_inflate_[adr >> 6] &= ~bit;
+}
+
+inline bool GridMap::isInflateSegmentOccupied(int x, int y, int z_min, int z_max) {
+#if GRID_MAP_BRICKED_LAYOUT
+  for (int z = z_min; z <= z_max; ++z)
+    if (getInflateBit(toAddress(x, y, z))) return true;
+  return false;
+#else
+  // the column is contiguous in the address space, only the first and last word are partial
+  int adr0 = toAddress(x, y, z_min), adr1 = adr0 + z_max - z_min;
+  const uint64_t* words = md_.occupancy_buffer_inflate_.data();
+  uint64_t first = ~uint64_t(0) << (adr0 & 63), last = ~uint64_t(0) >> (63 - (adr1 & 63));
+  int w0 = adr0 >> 6, w1 = adr1 >> 6;
+
+  if (w0 == w1) return words[w0] & first & last;
+  if (words[w0] & first) return true;
+  for (int w = w0 + 1; w < w1; ++w)
+    if (words[w]) return true;
+  return words[w1] & last;
+#endif
+}
+
+inline void GridMap::clearInflateSegment(int x, int y, int z_min, int z_max) {
+#if GRID_MAP_BRICKED_LAYOUT
+  for (int z = z_min; z <= z_max; ++z) setInflateBit(toAddress(x, y, z), false);
+#else
+  int adr0 = toAddress(x, y, z_min), adr1 = adr0 + z_max - z_min;
+  uint64_t* words = md_.occupancy_buffer_inflate_.data();
+  uint64_t first = ~uint64_t(0) << (adr0 & 63), last = ~uint64_t(0) >> (63 - (adr1 & 63));
+  int w0 = adr0 >> 6, w1 = adr1 >> 6;
+
+  if (w0 == w1) {
+    words[w0] &= ~(first & last);
+    return;
+  }
+  words[w0] &= ~first;
+  for (int w = w0 + 1; w < w1; ++w) words[w] = 0;
+  words[w1] &= ~last;
+#endif
+}
+
+inline bool GridMap::isInflateColumnOccupied(int x, int y) {
+  return isInflateSegmentOccupied(x, y, 0, mp_.map_voxel_num_(2) - 1);
 }
 
 inline int GridMap::getOccupancy(Eigen::Vector3i id) {
@@ -514,27 +733,30 @@ inline void GridMap::indexToPos(const Eigen::Vector3i& id, Eigen::Vector3d& pos)
   for (int i = 0; i < 3; ++i) pos(i) = (id(i) + 0.5) * mp_.resolution_ + mp_.map_origin_(i);
 }
 
+// pull a projected point into the map and within the max ray length, 1 if it is a hit
+inline int GridMap::clampRayEnd(Eigen::Vector3d& pt_w) {
+  double length;
+
+  if (!isInMap(pt_w)) {
+    pt_w = closetPointInMap(pt_w, md_.camera_pos_);
+
+    length = (pt_w - md_.camera_pos_).norm();
+    if (length > mp_.max_ray_length_)
+      pt_w = (pt_w - md_.camera_pos_) / length * mp_.max_ray_length_ + md_.camera_pos_;
+    return 0;
+  }
+
+  length = (pt_w - md_.camera_pos_).norm();
+  if (length > mp_.max_ray_length_) {
+    pt_w = (pt_w - md_.camera_pos_) / length * mp_.max_ray_length_ + md_.camera_pos_;
+    return 0;
+  }
+  return 1;
+}
+
 inline void GridMap::inflatePoint(const Eigen::Vector3i& pt, int step, vector<Eigen::Vector3i>& pts) {
   int num = 0;
 
-  /* ---------- + shape inflate ---------- */
-  // for (int x = -step; x <= step; ++x)
-  // {
-  //   if (x == 0)
-  //     continue;
-  //   pts[num++] = Eigen::Vector3i(pt(0) + x, pt(1), pt(2));
-  // }
-  // for (int y = -step; y <= step; ++y)
-  // {
-  //   if (y == 0)
-  //     continue;
-  //   pts[num++] = Eigen::Vector3i(pt(0), pt(1) + y, pt(2));
-  // }
-  // for (int z = -1; z <= 1; ++z)
-  // {
-  //   pts[num++] = Eigen::Vector3i(pt(0), pt(1), pt(2) + z);
-  // }
-
   /* ---------- all inflate ---------- */
   for (int x = -step; x <= step; ++x)
     for (int y = -step; y <= step; ++y)
@@ -543,6 +765,22 @@ inline void GridMap::inflatePoint(const Eigen::Vector3i& pt, int step, vector<Ei
       }
 }
 
+// in and out hold n consecutive blocks of block voxels, a voxel of out block i is set if it is set in
+// any of in blocks i - step .. i + step. count holds the running window sum of each voxel of a block
+inline void GridMap::dilateAxis(const char* in, char* out, int n, int block, int step, int* count) {
+  std::fill(count, count + block, 0);
+  for (int i = 0; i < min(step, n); ++i)
+    for (int k = 0; k < block; ++k) count[k] += in[i * block + k];
+
+  for (int i = 0; i < n; ++i) {
+    if (i + step < n)
+      for (int k = 0; k < block; ++k) count[k] += in[(i + step) * block + k];
+    for (int k = 0; k < block; ++k) out[i * block + k] = count[k] > 0;
+    if (i - step >= 0)
+      for (int k = 0; k < block; ++k) count[k] -= in[(i - step) * block + k];
+  }
+}
+
 inline double GridMap::getResolution() { return mp_.resolution_; }
 inline double GridMap::getResolution_inv() { return mp_.resolution_inv_; }
 
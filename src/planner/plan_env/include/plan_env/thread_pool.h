@@ -0,0 +1,96 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops.
+// parallelFor() splits [0, n) into one contiguous chunk per thread (the calling thread runs
+// chunk 0) and blocks until all chunks are done. It must not be called concurrently.
+class ThreadPool {
+public:
+  explicit ThreadPool(int num_threads)
+      : num_threads_(std::max(1, num_threads)), stop_(false), generation_(0), pending_(0), n_(0),
+        task_(NULL) {
+    for (int i = 1; i < num_threads_; ++i) workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_task_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int size() const { return num_threads_; }
+
+  // task(thread_id, begin, end)
+  void parallelFor(int n, const std::function<void(int, int, int)>& task) {
+    if (num_threads_ == 1 || n < 2) {
+      if (n > 0) task(0, 0, n);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      n_ = n;
+      pending_ = num_threads_ - 1;
+      ++generation_;
+    }
+    cv_task_.notify_all();
+
+    runChunk(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_done_.wait(lock, [this] { return pending_ == 0; });
+    task_ = NULL;
+  }
+
+private:
+  void runChunk(int id) {
+    int begin = (long)n_ * id / num_threads_;
+    int end = (long)n_ * (id + 1) / num_threads_;
+    if (begin < end) (*task_)(id, begin, end);
+  }
+
+  void workerLoop(int id) {
+    size_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_task_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+      }
+
+      runChunk(id);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) cv_done_.notify_one();
+      }
+    }
+  }
+
+  int num_threads_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_task_, cv_done_;
+  bool stop_;
+  size_t generation_;
+  int pending_;
+  int n_;
+  const std::function<void(int, int, int)>* task_;
+};
+
+#endif
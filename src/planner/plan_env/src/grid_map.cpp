@@ -57,6 +57,13 @@ void GridMap::initMap(ros::NodeHandle &nh)
   node_.param("grid_map/esdf_x_bound", mp_.esdf_x_bound_, 1);
   node_.param("grid_map/esdf_y_bound", mp_.esdf_y_bound_, 1);
   node_.param("grid_map/esdf_z_bound", mp_.esdf_z_bound_, 1);
+  node_.param("grid_map/esdf_threads", mp_.esdf_threads_, 1);
+  node_.param("grid_map/esdf_check_serial", mp_.esdf_check_serial_, false);
+  node_.param("grid_map/esdf_incremental", mp_.esdf_incremental_, false);
+  node_.param("grid_map/esdf_recenter_margin", mp_.esdf_recenter_margin_, 5);
+  double rolling_margin;
+  node_.param("grid_map/rolling_map", mp_.rolling_map_, false);
+  node_.param("grid_map/rolling_margin", rolling_margin, 1.0);
   // node_.param("grid_map/esdf_x_bound_down", mp_.esdf_x_bound_down_, 1);
   // node_.param("grid_map/esdf_y_bound_down", mp_.esdf_y_bound_down_, 1);
   // node_.param("grid_map/esdf_z_bound_down", mp_.esdf_z_bound_down_, 1);
@@ -82,15 +89,31 @@ void GridMap::initMap(ros::NodeHandle &nh)
 
   mp_.map_min_boundary_ = mp_.map_origin_;
   mp_.map_max_boundary_ = mp_.map_origin_ + mp_.map_size_;
+  mp_.rolling_margin_ = max(0, int(ceil(rolling_margin / mp_.resolution_)));
+  md_.ring_offset_ = Eigen::Vector3i::Zero();
+#if !GRID_MAP_ROLLING_MAP
+  if (mp_.rolling_map_)
+  {
+    ROS_WARN("grid_map/rolling_map needs GRID_MAP_ROLLING_MAP, keeping a fixed map");
+    mp_.rolling_map_ = false;
+  }
+#endif
 
   // initialize data buffers
 
+  for (int i = 0; i < 3; ++i)
+    mp_.map_brick_num_(i) = (mp_.map_voxel_num_(i) + 7) / 8;
+
+#if GRID_MAP_BRICKED_LAYOUT
+  int buffer_size = mp_.map_brick_num_(0) * mp_.map_brick_num_(1) * mp_.map_brick_num_(2) * 512;
+#else
   int buffer_size = mp_.map_voxel_num_(0) * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2);
+#endif
 
   md_.buffer_size_ = buffer_size;
   
-  md_.occupancy_buffer_ = vector<double>(buffer_size, mp_.clamp_min_log_ - mp_.unknown_flag_);
-  md_.occupancy_buffer_inflate_ = vector<char>(buffer_size, 0);
+  md_.occupancy_buffer_ = vector<GridScalar>(buffer_size, mp_.clamp_min_log_ - mp_.unknown_flag_);
+  md_.occupancy_buffer_inflate_ = vector<uint64_t>((buffer_size + 63) / 64, 0);
 
   md_.count_hit_and_miss_ = vector<short>(buffer_size, 0);
   md_.count_hit_ = vector<short>(buffer_size, 0);
@@ -98,16 +121,57 @@ void GridMap::initMap(ros::NodeHandle &nh)
   md_.flag_traverse_ = vector<char>(buffer_size, -1);
 
 
-  md_.tmp_buffer1_ = vector<double>(md_.buffer_size_, 0);
-  md_.tmp_buffer2_ = vector<double>(md_.buffer_size_, 0);
-  md_.distance_buffer_ = vector<double>(md_.buffer_size_, 0);
-  md_.distance_buffer_all_ = vector<double>(md_.buffer_size_, 0);
-  md_.distance_buffer_neg_ = vector<double>(md_.buffer_size_, 0);
+  md_.tmp_buffer1_ = vector<GridScalar>(md_.buffer_size_, 0);
+  md_.tmp_buffer2_ = vector<GridScalar>(md_.buffer_size_, 0);
+  md_.distance_buffer_ = vector<GridScalar>(md_.buffer_size_, 0);
+  md_.distance_buffer_all_ = vector<GridScalar>(md_.buffer_size_, 0);
+  md_.distance_buffer_neg_ = vector<GridScalar>(md_.buffer_size_, 0);
   md_.occupancy_buffer_neg = vector<char>(md_.buffer_size_, 0);
 
+  // one scanline buffer per esdf worker, the longest scanline spans a whole map axis
+  mp_.esdf_threads_ = max(1, mp_.esdf_threads_);
+  int max_voxel_num = mp_.map_voxel_num_.maxCoeff();
+  esdf_scratch_.resize(mp_.esdf_threads_);
+  for (ESDFScratch &scratch : esdf_scratch_)
+  {
+    scratch.f.resize(max_voxel_num);
+    scratch.d.resize(max_voxel_num);
+    scratch.v.resize(max_voxel_num);
+    scratch.adr.resize(max_voxel_num);
+    scratch.z.resize(max_voxel_num + 1);
+  }
+  if (mp_.esdf_threads_ > 1)
+    esdf_pool_.reset(new ThreadPool(mp_.esdf_threads_));
+
+  int inf_step = ceil(mp_.obstacles_inflation_ / mp_.resolution_);
+  int inf_step_z = 1;
+  for (int x = -inf_step; x <= inf_step; ++x)
+    for (int y = -inf_step; y <= inf_step; ++y)
+      for (int z = -inf_step_z; z <= inf_step_z; ++z)
+        inf_stencil_.push_back(Eigen::Vector3i(x, y, z));
+
+  // a point in update range is at most ceil(range / resolution) voxels from the camera voxel
+  for (int i = 0; i < 3; ++i)
+    cloud_box_num_(i) = 2 * int(ceil(mp_.local_update_range_(i) * mp_.resolution_inv_)) + 3;
+  cloud_flag_ = vector<char>(cloud_box_num_.prod(), 0);
+
+  if (mp_.esdf_incremental_)
+  {
+    md_.tmp_buffer_neg1_ = vector<GridScalar>(md_.buffer_size_, 0);
+    md_.tmp_buffer_neg2_ = vector<GridScalar>(md_.buffer_size_, 0);
+  }
+
+  if (mp_.show_occ_time_)
+  {
+    double voxel_bytes = (mp_.esdf_incremental_ ? 8 : 6) * sizeof(GridScalar) + 3 * sizeof(char) + 1 / 8.0 +
+                         2 * sizeof(short);
+    cout << "map buffers: " << buffer_size << " voxels, " << sizeof(GridScalar) << "-byte scalars, "
+         << voxel_bytes * buffer_size / (1024.0 * 1024.0) << " MB" << endl;
+  }
+
   md_.raycast_num_ = 0;
 
-  md_.proj_points_.resize(640 * 480 / mp_.skip_pixel_ / mp_.skip_pixel_);
+  initRayTable(640, 480);
   md_.proj_points_cnt = 0;
 
   md_.cam2body_ << 0.0, 0.0, 1.0, 0.0,
@@ -174,6 +238,10 @@ void GridMap::initMap(ros::NodeHandle &nh)
   md_.flag_depth_odom_timeout_ = false;
   md_.flag_use_depth_fusion = false;
 
+  md_.min_esdf_ = md_.max_esdf_ = Eigen::Vector3i::Zero();
+  md_.esdf_inc_ready_ = false;
+  md_.esdf_dirty_ = false;
+
   // rand_noise_ = uniform_real_distribution<double>(-0.2, 0.2);
   // rand_noise2_ = normal_distribution<double>(0, 0.2);
   // random_device rd;
@@ -201,13 +269,80 @@ void GridMap::resetBuffer(Eigen::Vector3d min_pos, Eigen::Vector3d max_pos)
   boundIndex(min_id);
   boundIndex(max_id);
 
+  markESDFDirty(min_id, max_id);
+
   /* reset occ and dist buffer */
   for (int x = min_id(0); x <= max_id(0); ++x)
     for (int y = min_id(1); y <= max_id(1); ++y)
-      for (int z = min_id(2); z <= max_id(2); ++z)
-      {
-        md_.occupancy_buffer_inflate_[toAddress(x, y, z)] = 0;
-      }
+      clearInflateSegment(x, y, min_id(2), max_id(2));
+}
+
+void GridMap::rollMap(const Eigen::Vector3d &center)
+{
+  Eigen::Vector3i center_id;
+  posToIndex(center, center_id);
+  Eigen::Vector3i shift = center_id - mp_.map_voxel_num_ / 2;
+  shift(2) = 0;
+
+  if (abs(shift(0)) <= mp_.rolling_margin_ && abs(shift(1)) <= mp_.rolling_margin_)
+    return;
+
+  /* move the origin by whole voxels and rotate the ring so that stored voxels keep their position */
+  for (int i = 0; i < 2; ++i)
+  {
+    int n = mp_.map_voxel_num_(i);
+    md_.ring_offset_(i) = ((md_.ring_offset_(i) + shift(i)) % n + n) % n;
+  }
+  mp_.map_origin_ += shift.cast<double>() * mp_.resolution_;
+  mp_.map_min_boundary_ = mp_.map_origin_;
+  mp_.map_max_boundary_ = mp_.map_origin_ + mp_.map_size_;
+
+  auto clear_voxel = [&](int adr) {
+    md_.occupancy_buffer_[adr] = mp_.clamp_min_log_ - mp_.unknown_flag_;
+    setInflateBit(adr, false);
+    md_.count_hit_[adr] = md_.count_hit_and_miss_[adr] = 0;
+    md_.flag_rayend_[adr] = md_.flag_traverse_[adr] = -1;
+    md_.tmp_buffer1_[adr] = md_.tmp_buffer2_[adr] = 0;
+    md_.distance_buffer_[adr] = md_.distance_buffer_all_[adr] = md_.distance_buffer_neg_[adr] = 0;
+    md_.occupancy_buffer_neg[adr] = 0;
+    if (mp_.esdf_incremental_)
+      md_.tmp_buffer_neg1_[adr] = md_.tmp_buffer_neg2_[adr] = 0;
+  };
+
+  /* clear the slabs that scrolled in, they still hold the data that scrolled out */
+  for (int i = 0; i < 2; ++i)
+  {
+    if (shift(i) == 0)
+      continue;
+
+    int n = mp_.map_voxel_num_(i);
+    int width = min(abs(shift(i)), n);
+    Eigen::Vector3i min_id = Eigen::Vector3i::Zero();
+    Eigen::Vector3i max_id = mp_.map_voxel_num_ - Eigen::Vector3i::Ones();
+    if (shift(i) > 0)
+      min_id(i) = n - width;
+    else
+      max_id(i) = width - 1;
+
+    for (int x = min_id(0); x <= max_id(0); ++x)
+      for (int y = min_id(1); y <= max_id(1); ++y)
+        for (int z = min_id(2); z <= max_id(2); ++z)
+          clear_voxel(toAddress(x, y, z));
+  }
+
+  /* indices kept across updates refer to the old origin */
+  md_.min_esdf_ -= shift;
+  md_.max_esdf_ -= shift;
+  md_.local_bound_min_ -= shift;
+  md_.local_bound_max_ -= shift;
+  md_.esdf_dirty_min_ -= shift;
+  md_.esdf_dirty_max_ -= shift;
+  boundIndex(md_.min_esdf_);
+  boundIndex(md_.max_esdf_);
+  boundIndex(md_.local_bound_min_);
+  boundIndex(md_.local_bound_max_);
+
+  md_.esdf_inc_ready_ = false;
 }
 
 int GridMap::setCacheOccupancy(Eigen::Vector3d pos, int occ)
@@ -217,6 +352,11 @@ int GridMap::setCacheOccupancy(Eigen::Vector3d pos, int occ)
 
   Eigen::Vector3i id;
   posToIndex(pos, id);
+  return setCacheOccupancy(id, occ);
+}
+
+int GridMap::setCacheOccupancy(const Eigen::Vector3i &id, int occ)
+{
   int idx_ctns = toAddress(id);
 
   md_.count_hit_and_miss_[idx_ctns] += 1;
@@ -232,128 +372,129 @@ int GridMap::setCacheOccupancy(Eigen::Vector3d pos, int occ)
   return idx_ctns;
 }
 
-void GridMap::projectDepthImage()
+void GridMap::initRayTable(int cols, int rows)
 {
-  // md_.proj_points_.clear();
-  md_.proj_points_cnt = 0;
-
-  uint16_t *row_ptr;
-  // int cols = current_img_.cols, rows = current_img_.rows;
-  int cols = md_.depth_image_.cols;
-  int rows = md_.depth_image_.rows;
   int skip_pix = mp_.skip_pixel_;
+  int margin = mp_.use_depth_filter_ ? mp_.depth_filter_margin_ : 0;
 
-  double depth;
+  int col_num = max(0, (cols - 2 * margin + skip_pix - 1) / skip_pix);
+  int row_num = max(0, (rows - 2 * margin + skip_pix - 1) / skip_pix);
 
-  Eigen::Matrix3d camera_r = md_.camera_r_m_;
+  md_.ray_table_u_.resize(col_num);
+  for (int k = 0; k < col_num; ++k)
+    md_.ray_table_u_(k) = (margin + k * skip_pix - mp_.cx_) / mp_.fx_;
 
-  if (!mp_.use_depth_filter_)
-  {
-    for (int v = 0; v < rows; v+=skip_pix)
-    {
-      row_ptr = md_.depth_image_.ptr<uint16_t>(v);
+  md_.ray_table_v_.resize(row_num);
+  for (int j = 0; j < row_num; ++j)
+    md_.ray_table_v_(j) = (margin + j * skip_pix - mp_.cy_) / mp_.fy_;
 
-      for (int u = 0; u < cols; u+=skip_pix)
-      {
+  md_.ray_table_cols_ = cols;
+  md_.ray_table_rows_ = rows;
+  md_.proj_points_.resize(row_num * col_num, 3);
+}
 
-        Eigen::Vector3d proj_pt;
-        depth = (*row_ptr++) / mp_.k_depth_scaling_factor_;
-        proj_pt(0) = (u - mp_.cx_) * depth / mp_.fx_;
-        proj_pt(1) = (v - mp_.cy_) * depth / mp_.fy_;
-        proj_pt(2) = depth;
+void GridMap::projectDepthImage()
+{
+  md_.proj_points_cnt = 0;
 
-        proj_pt = camera_r * proj_pt + md_.camera_pos_;
+  if (md_.depth_image_.cols != md_.ray_table_cols_ || md_.depth_image_.rows != md_.ray_table_rows_)
+    initRayTable(md_.depth_image_.cols, md_.depth_image_.rows);
 
-        if (u == 320 && v == 240)
-          std::cout << "depth: " << depth << std::endl;
-        md_.proj_points_[md_.proj_points_cnt++] = proj_pt;
-      }
-    }
-  }
   /* use depth filter */
+  if (mp_.use_depth_filter_ && !md_.has_first_depth_)
+  {
+    md_.has_first_depth_ = true;
+  }
   else
   {
+    md_.proj_points_cnt = projectDepthRows(0, md_.ray_table_v_.size());
+  }
 
-    if (!md_.has_first_depth_)
-      md_.has_first_depth_ = true;
-    else
-    {
-      Eigen::Vector3d pt_cur, pt_world, pt_reproj;
-
-      Eigen::Matrix3d last_camera_r_inv;
-      last_camera_r_inv = md_.last_camera_r_m_.inverse();
-      const double inv_factor = 1.0 / mp_.k_depth_scaling_factor_;
-
-      for (int v = mp_.depth_filter_margin_; v < rows - mp_.depth_filter_margin_; v += mp_.skip_pixel_)
-      {
-        row_ptr = md_.depth_image_.ptr<uint16_t>(v) + mp_.depth_filter_margin_;
-
-        for (int u = mp_.depth_filter_margin_; u < cols - mp_.depth_filter_margin_;
-             u += mp_.skip_pixel_)
-        {
-
-          depth = (*row_ptr) * inv_factor;
-          row_ptr = row_ptr + mp_.skip_pixel_;
+  /* maintain camera pose for consistency check */
 
-          // filter depth
-          // depth += rand_noise_(eng_);
-          // if (depth > 0.01) depth += rand_noise2_(eng_);
+  md_.last_camera_pos_ = md_.camera_pos_;
+  md_.last_camera_r_m_ = md_.camera_r_m_;
+  md_.last_depth_image_ = md_.depth_image_;
+}
 
-          if (*row_ptr == 0)
-          {
-            depth = mp_.max_ray_length_ + 0.1;
-          }
-          else if (depth < mp_.depth_filter_mindist_)
-          {
-            continue;
-          }
-          else if (depth > mp_.depth_filter_maxdist_)
-          {
-            depth = mp_.max_ray_length_ + 0.1;
-          }
+// project the sampled rows [row_begin, row_end) of the depth image into proj_points_, returns the
+// number of points written
+int GridMap::projectDepthRows(int row_begin, int row_end)
+{
+  int cnt = 0;
+  int col_num = md_.ray_table_u_.size();
+  int skip_pix = mp_.skip_pixel_;
+  int margin = mp_.use_depth_filter_ ? mp_.depth_filter_margin_ : 0;
+  // copied to locals, the compiler can't tell that the point buffer writes leave them unchanged
+  const double inv_factor = 1.0 / mp_.k_depth_scaling_factor_;
+  const double far_depth = mp_.max_ray_length_ + 0.1;
+  const double min_depth = mp_.depth_filter_mindist_, max_depth = mp_.depth_filter_maxdist_;
+  const double *ray_u = md_.ray_table_u_.data();
 
-          // project to world frame
-          pt_cur(0) = (u - mp_.cx_) * depth / mp_.fx_;
-          pt_cur(1) = (v - mp_.cy_) * depth / mp_.fy_;
-          pt_cur(2) = depth;
+  const Eigen::Matrix3d camera_r = md_.camera_r_m_;
+  const Eigen::Vector3d camera_pos = md_.camera_pos_;
 
-          pt_world = camera_r * pt_cur + md_.camera_pos_;
-          // if (!isInMap(pt_world)) {
-          //   pt_world = closetPointInMap(pt_world, md_.camera_pos_);
-          // }
+  double *xs = md_.proj_points_.col(0).data();
+  double *ys = md_.proj_points_.col(1).data();
+  double *zs = md_.proj_points_.col(2).data();
 
-          md_.proj_points_[md_.proj_points_cnt++] = pt_world;
+  for (int j = row_begin; j < row_end; ++j)
+  {
+    const uint16_t *row_ptr = md_.depth_image_.ptr<uint16_t>(margin + j * skip_pix) + margin;
+    double *x = xs + cnt, *y = ys + cnt, *z = zs + cnt;
+    int row_cnt = 0;
 
-          // check consistency with last image, disabled...
-          if (false)
-          {
-            pt_reproj = last_camera_r_inv * (pt_world - md_.last_camera_pos_);
-            double uu = pt_reproj.x() * mp_.fx_ / pt_reproj.z() + mp_.cx_;
-            double vv = pt_reproj.y() * mp_.fy_ / pt_reproj.z() + mp_.cy_;
+    // gather the depth of the kept pixels into z and their column ray into y
+    if (!mp_.use_depth_filter_)
+    {
+      for (int k = 0; k < col_num; ++k)
+      {
+        z[k] = row_ptr[k * skip_pix] * inv_factor;
+        y[k] = ray_u[k];
+      }
+      row_cnt = col_num;
+    }
+    else
+    {
+      // no depth reading or too far: cast a free ray
+      for (int k = 0; k < col_num; ++k)
+      {
+        uint16_t raw = row_ptr[k * skip_pix];
+        double depth = raw * inv_factor;
+        z[k] = (raw == 0 || depth > max_depth) ? far_depth : depth;
+        y[k] = ray_u[k];
+      }
 
-            if (uu >= 0 && uu < cols && vv >= 0 && vv < rows)
-            {
-              if (fabs(md_.last_depth_image_.at<uint16_t>((int)vv, (int)uu) * inv_factor -
-                       pt_reproj.z()) < mp_.depth_filter_tolerance_)
-              {
-                md_.proj_points_[md_.proj_points_cnt++] = pt_world;
-              }
-            }
-            else
-            {
-              md_.proj_points_[md_.proj_points_cnt++] = pt_world;
-            }
-          }
-        }
+      // too close: drop the pixel, the rest of the row is packed from the first one dropped
+      while (row_cnt < col_num && z[row_cnt] >= min_depth)
+        ++row_cnt;
+      for (int k = row_cnt; k < col_num; ++k)
+      {
+        if (z[k] < min_depth)
+          continue;
+        z[row_cnt] = z[k];
+        y[row_cnt] = y[k];
+        ++row_cnt;
       }
     }
-  }
 
-  /* maintain camera pose for consistency check */
+    // p = camera_pos + depth * camera_r * (ray_u, ray_v, 1), in place
+    Eigen::Vector3d row_dir = camera_r.col(1) * md_.ray_table_v_(j) + camera_r.col(2);
+    const double r0 = camera_r(0, 0), r1 = camera_r(1, 0), r2 = camera_r(2, 0);
+    const double d0 = row_dir(0), d1 = row_dir(1), d2 = row_dir(2);
+    const double t0 = camera_pos(0), t1 = camera_pos(1), t2 = camera_pos(2);
+    for (int k = 0; k < row_cnt; ++k)
+    {
+      double depth = z[k], ray = y[k];
+      x[k] = t0 + depth * (ray * r0 + d0);
+      y[k] = t1 + depth * (ray * r1 + d1);
+      z[k] = t2 + depth * (ray * r2 + d2);
+    }
 
-  md_.last_camera_pos_ = md_.camera_pos_;
-  md_.last_camera_r_m_ = md_.camera_r_m_;
-  md_.last_depth_image_ = md_.depth_image_;
+    cnt += row_cnt;
+  }
+
+  return cnt;
 }
 
 void GridMap::raycastProcess()
@@ -384,35 +525,10 @@ void GridMap::raycastProcess()
 
   for (int i = 0; i < md_.proj_points_cnt; ++i)
   {
-    pt_w = md_.proj_points_[i];
+    pt_w = md_.proj_points_.row(i).transpose();
 
     // set flag for projected point
-
-    if (!isInMap(pt_w))
-    {
-      pt_w = closetPointInMap(pt_w, md_.camera_pos_);
-
-      length = (pt_w - md_.camera_pos_).norm();
-      if (length > mp_.max_ray_length_)
-      {
-        pt_w = (pt_w - md_.camera_pos_) / length * mp_.max_ray_length_ + md_.camera_pos_;
-      }
-      vox_idx = setCacheOccupancy(pt_w, 0);
-    }
-    else
-    {
-      length = (pt_w - md_.camera_pos_).norm();
-
-      if (length > mp_.max_ray_length_)
-      {
-        pt_w = (pt_w - md_.camera_pos_) / length * mp_.max_ray_length_ + md_.camera_pos_;
-        vox_idx = setCacheOccupancy(pt_w, 0);
-      }
-      else
-      {
-        vox_idx = setCacheOccupancy(pt_w, 1);
-      }
-    }
+    vox_idx = setCacheOccupancy(pt_w, clampRayEnd(pt_w));
 
     max_x = max(max_x, pt_w(0));
     max_y = max(max_y, pt_w(1));
@@ -501,11 +617,11 @@ void GridMap::raycastProcess()
 
     md_.count_hit_[idx_ctns] = md_.count_hit_and_miss_[idx_ctns] = 0;
 
-    if (log_odds_update >= 0 && md_.occupancy_buffer_[idx_ctns] >= mp_.clamp_max_log_)
+    if (log_odds_update >= 0 && md_.occupancy_buffer_[idx_ctns] >= (GridScalar)mp_.clamp_max_log_)
     {
       continue;
     }
-    else if (log_odds_update <= 0 && md_.occupancy_buffer_[idx_ctns] <= mp_.clamp_min_log_)
+    else if (log_odds_update <= 0 && md_.occupancy_buffer_[idx_ctns] <= (GridScalar)mp_.clamp_min_log_)
     {
       md_.occupancy_buffer_[idx_ctns] = mp_.clamp_min_log_;
       continue;
@@ -627,63 +743,114 @@ void GridMap::clearAndInflateLocalMap()
   // inflate occupied voxels to compensate robot size
 
   int inf_step = ceil(mp_.obstacles_inflation_ / mp_.resolution_);
-  // int inf_step_z = 1;
-  vector<Eigen::Vector3i> inf_pts(pow(2 * inf_step + 1, 3));
-  // inf_pts.resize(4 * inf_step + 3);
-  Eigen::Vector3i inf_pt;
-
-  // clear outdated data
-  for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
-    for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y)
-      for (int z = md_.local_bound_min_(2); z <= md_.local_bound_max_(2); ++z)
-      {
-        md_.occupancy_buffer_inflate_[toAddress(x, y, z)] = 0;
-      }
 
-  // inflate obstacles
-  for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
-    for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y)
-      for (int z = md_.local_bound_min_(2); z <= md_.local_bound_max_(2); ++z)
-      {
+  markESDFDirty(md_.local_bound_min_ - Eigen::Vector3i::Constant(inf_step),
+                md_.local_bound_max_ + Eigen::Vector3i::Constant(inf_step));
+
+  if (inf_step <= 1)
+  {
+    // the stencil of a small radius is cheaper than the passes over the grown bound
+    vector<Eigen::Vector3i> inf_pts(pow(2 * inf_step + 1, 3));
+    Eigen::Vector3i inf_pt;
 
-        if (md_.occupancy_buffer_[toAddress(x, y, z)] > mp_.min_occupancy_log_)
+    // clear outdated data
+    for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
+      for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y)
+        for (int z = md_.local_bound_min_(2); z <= md_.local_bound_max_(2); ++z)
         {
-          inflatePoint(Eigen::Vector3i(x, y, z), inf_step, inf_pts);
+          setInflateBit(toAddress(x, y, z), false);
+        }
 
-          for (int k = 0; k < (int)inf_pts.size(); ++k)
+    // inflate obstacles
+    for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
+      for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y)
+        for (int z = md_.local_bound_min_(2); z <= md_.local_bound_max_(2); ++z)
+        {
+          if (md_.occupancy_buffer_[toAddress(x, y, z)] > mp_.min_occupancy_log_)
           {
-            inf_pt = inf_pts[k];
-            int idx_inf = toAddress(inf_pt);
-            if (idx_inf < 0 ||
-                idx_inf >= mp_.map_voxel_num_(0) * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2))
+            inflatePoint(Eigen::Vector3i(x, y, z), inf_step, inf_pts);
+
+            for (int k = 0; k < (int)inf_pts.size(); ++k)
             {
-              continue;
+              inf_pt = inf_pts[k];
+              if (!isInMap(inf_pt))
+                continue;
+
+              setInflateBit(toAddress(inf_pt), true);
             }
-            md_.occupancy_buffer_inflate_[idx_inf] = 1;
           }
         }
+  }
+  else
+  {
+    // inflate obstacles: the cube of half width inf_step around each occupied voxel of the local bound
+    // is the product of three intervals, so it is dilated one axis at a time over the grown bound
+    Eigen::Vector3i dil_min = md_.local_bound_min_ - Eigen::Vector3i::Constant(inf_step);
+    Eigen::Vector3i dil_max = md_.local_bound_max_ + Eigen::Vector3i::Constant(inf_step);
+    boundIndex(dil_min);
+    boundIndex(dil_max);
+    Eigen::Vector3i dil_num = dil_max - dil_min + Eigen::Vector3i::Ones();
+
+    if ((int)dilate_buffer1_.size() < dil_num.prod())
+    {
+      dilate_buffer1_.resize(dil_num.prod());
+      dilate_buffer2_.resize(dil_num.prod());
+    }
+    if ((int)dilate_count_.size() < dil_num(1) * dil_num(2))
+      dilate_count_.resize(dil_num(1) * dil_num(2));
+    char *occ = dilate_buffer1_.data(), *dil = dilate_buffer2_.data();
+    std::fill(occ, occ + dil_num.prod(), 0);
+
+    for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
+      for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y)
+        for (int z = md_.local_bound_min_(2); z <= md_.local_bound_max_(2); ++z)
+        {
+          int adr = ((x - dil_min(0)) * dil_num(1) + y - dil_min(1)) * dil_num(2) + z - dil_min(2);
+          occ[adr] = md_.occupancy_buffer_[toAddress(x, y, z)] > mp_.min_occupancy_log_;
+        }
+
+    // z along each column, y over the columns of each x slice, x over the slices
+    int yz_num = dil_num(1) * dil_num(2);
+    for (int xy = 0; xy < dil_num(0) * dil_num(1); ++xy)
+      dilateAxis(occ + xy * dil_num(2), dil + xy * dil_num(2), dil_num(2), 1, inf_step, dilate_count_.data());
+    for (int x = 0; x < dil_num(0); ++x)
+      dilateAxis(dil + x * yz_num, occ + x * yz_num, dil_num(1), dil_num(2), inf_step, dilate_count_.data());
+    dilateAxis(occ, dil, dil_num(0), yz_num, inf_step, dilate_count_.data());
+
+    // outdated data inside the local bound is cleared, outside it the inflation is only added
+    const Eigen::Vector3i &lmin = md_.local_bound_min_, &lmax = md_.local_bound_max_;
+    for (int x = dil_min(0); x <= dil_max(0); ++x)
+      for (int y = dil_min(1); y <= dil_max(1); ++y)
+      {
+        bool xy_local = x >= lmin(0) && x <= lmax(0) && y >= lmin(1) && y <= lmax(1);
+        for (int z = dil_min(2); z <= dil_max(2); ++z)
+        {
+          if (dil[((x - dil_min(0)) * dil_num(1) + y - dil_min(1)) * dil_num(2) + z - dil_min(2)])
+            setInflateBit(toAddress(x, y, z), true);
+          else if (xy_local && z >= lmin(2) && z <= lmax(2))
+            setInflateBit(toAddress(x, y, z), false);
+        }
       }
+  }
 
   // add virtual ceiling to limit flight height
   if (mp_.virtual_ceil_height_ > -0.5) {
     int ceil_id = floor((mp_.virtual_ceil_height_ - mp_.map_origin_(2)) * mp_.resolution_inv_);
     for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
       for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y) {
-        md_.occupancy_buffer_inflate_[toAddress(x, y, ceil_id)] = 1;
+        setInflateBit(toAddress(x, y, ceil_id), true);
       }
   }
 }
 
 
-template <typename F_get_val, typename F_set_val>
-void GridMap::fillESDF(F_get_val f_get_val, F_set_val f_set_val, int start, int end, int dim) {
-  int v[mp_.map_voxel_num_(dim)];
-  double z[mp_.map_voxel_num_(dim) + 1];
-
-  int k = start;
-  v[start] = start;
-  z[start] = -std::numeric_limits<double>::max();
-  z[start + 1] = std::numeric_limits<double>::max();
+void GridMap::fillESDF(const double *f, double *d, int *v, double *z, int start, int end)
+{
+  // 1D squared distance transform of one scanline, f and d are indexed from start
+  int k = 0;
+  v[0] = start;
+  z[0] = -std::numeric_limits<double>::max();
+  z[1] = std::numeric_limits<double>::max();
 
   for (int q = start + 1; q <= end; q++) {
     k++;
@@ -691,7 +858,7 @@ void GridMap::fillESDF(F_get_val f_get_val, F_set_val f_set_val, int start, int
 
     do {
       k--;
-      s = ((f_get_val(q) + q * q) - (f_get_val(v[k]) + v[k] * v[k])) / (2 * q - 2 * v[k]);
+      s = ((f[q - start] + q * q) - (f[v[k] - start] + v[k] * v[k])) / (2 * q - 2 * v[k]);
     } while (s <= z[k]);
 
     k++;
@@ -701,17 +868,90 @@ void GridMap::fillESDF(F_get_val f_get_val, F_set_val f_set_val, int start, int
     z[k + 1] = std::numeric_limits<double>::max();
   }
 
-  k = start;
+  k = 0;
 
   for (int q = start; q <= end; q++) {
     while (z[k + 1] < q) k++;
-    double val = (q - v[k]) * (q - v[k]) + f_get_val(v[k]);
-    f_set_val(q, val);
+    d[q - start] = (q - v[k]) * (q - v[k]) + f[v[k] - start];
   }
 }
 
+template <typename F_get_val, typename F_set_val>
+void GridMap::fillESDFPass(F_get_val f_get_val, F_set_val f_set_val, int dim, bool serial)
+{
+  // scanlines along dim inside the esdf window are independent and split among the workers
+  const Eigen::Vector3i min_esdf = md_.min_esdf_;
+  const Eigen::Vector3i max_esdf = md_.max_esdf_;
+  const int a0 = dim == 0 ? 1 : 0;
+  const int a1 = dim == 2 ? 1 : 2;
+  const int n1 = max_esdf(a1) - min_esdf(a1) + 1;
+  const int lines = (max_esdf(a0) - min_esdf(a0) + 1) * n1;
+
+  runESDFTask(lines, [&](int tid, int begin, int finish) {
+    Eigen::Vector3i id;
+
+    for (int l = begin; l < finish; ++l)
+    {
+      id(a0) = min_esdf(a0) + l / n1;
+      id(a1) = min_esdf(a1) + l % n1;
+      fillESDFScanline(f_get_val, f_set_val, id, dim, tid);
+    }
+  }, serial);
+}
 
-void GridMap::updateESDF3d()
+template <typename F_get_val, typename F_set_val>
+void GridMap::fillESDFScanline(F_get_val f_get_val, F_set_val f_set_val, Eigen::Vector3i id, int dim, int tid)
+{
+  // the scanline along dim through id spans the esdf window. It is gathered into a contiguous
+  // buffer of worker tid, transformed and scattered back.
+  ESDFScratch &scratch = esdf_scratch_[tid];
+  const int start = md_.min_esdf_(dim), end = md_.max_esdf_(dim);
+  id(dim) = start;
+
+#if !GRID_MAP_BRICKED_LAYOUT
+  // in x-major rows a scanline is evenly strided unless a rolling map wraps it around the ring
+  if (!GRID_MAP_ROLLING_MAP || md_.ring_offset_.isZero())
+  {
+    const int stride = dim == 0 ? mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2) :
+                       dim == 1 ? mp_.map_voxel_num_(2) : 1;
+    int adr = toAddress(id);
+
+    for (int q = 0; q <= end - start; ++q)
+      scratch.f[q] = f_get_val(adr + q * stride);
+
+    fillESDF(scratch.f.data(), scratch.d.data(), scratch.v.data(), scratch.z.data(), start, end);
+
+    for (int q = 0; q <= end - start; ++q)
+      f_set_val(adr + q * stride, scratch.d[q]);
+    return;
+  }
+#endif
+
+  // bricked or wrapped scanlines are scattered, their addresses are computed once and reused
+  for (int q = 0; q <= end - start; ++q)
+  {
+    id(dim) = start + q;
+    scratch.adr[q] = toAddress(id);
+    scratch.f[q] = f_get_val(scratch.adr[q]);
+  }
+
+  fillESDF(scratch.f.data(), scratch.d.data(), scratch.v.data(), scratch.z.data(), start, end);
+
+  for (int q = 0; q <= end - start; ++q)
+    f_set_val(scratch.adr[q], scratch.d[q]);
+}
+
+void GridMap::runESDFTask(int n, const std::function<void(int, int, int)> &task, bool serial)
+{
+  if (n <= 0) return;
+
+  if (serial || !esdf_pool_)
+    task(0, 0, n);
+  else
+    esdf_pool_->parallelFor(n, task);
+}
+
+void GridMap::updateESDF3d(bool serial)
 {
   //* 先确定update的一个范围
   int x_bound = mp_.esdf_x_bound_;
@@ -727,22 +967,25 @@ void GridMap::updateESDF3d()
   Eigen::Vector3i max_esdf = md_.max_esdf_;
 
   /* ========== clear ESDF ========== */
-  for (int x = min_esdf[0]; x <= max_esdf[0]; x++) {
-    for (int y = min_esdf[1]; y <= max_esdf[1]; y++) {
-      for(int z = min_esdf[2]; z <= max_esdf[2]; z++){
-        int idr = toAddress(x, y, z);
-        md_.tmp_buffer1_[idr] = 0;
-        md_.tmp_buffer2_[idr] = 0;
-        md_.distance_buffer_[idr] = 0;
-        md_.distance_buffer_all_[idr] = 0;
-        md_.distance_buffer_neg_[idr] = 0;
-        md_.occupancy_buffer_neg[idr] = 0;
+  runESDFTask(max_esdf[0] - min_esdf[0] + 1, [&](int, int begin, int end) {
+    for (int x = min_esdf[0] + begin; x < min_esdf[0] + end; x++) {
+      for (int y = min_esdf[1]; y <= max_esdf[1]; y++) {
+        for(int z = min_esdf[2]; z <= max_esdf[2]; z++){
+          int idr = toAddress(x, y, z);
+          md_.tmp_buffer1_[idr] = 0;
+          md_.tmp_buffer2_[idr] = 0;
+          md_.distance_buffer_[idr] = 0;
+          md_.distance_buffer_all_[idr] = 0;
+          md_.distance_buffer_neg_[idr] = 0;
+          md_.occupancy_buffer_neg[idr] = 0;
+        }
       }
     }
-  }
+  }, serial);
 
   md_.min_esdf_ = odom_index - esdf_bound;
   md_.max_esdf_ = odom_index + esdf_bound;
+  md_.esdf_dirty_ = false;
 
   boundIndex(md_.min_esdf_);
   boundIndex(md_.max_esdf_);
@@ -752,117 +995,304 @@ void GridMap::updateESDF3d()
 
   /* ========== compute positive DT ========== */
 
-  for (int x = min_esdf[0]; x <= max_esdf[0]; x++) {
-    for (int y = min_esdf[1]; y <= max_esdf[1]; y++) {
-      fillESDF(
-          [&](int z) {
-            return ( md_.occupancy_buffer_inflate_[toAddress(x, y, z)] == 1 ) ?
-                0 :
-                std::numeric_limits<double>::max();
-          },
-          [&](int z, double val) { md_.tmp_buffer1_[toAddress(x, y, z)] = val; }, min_esdf[2],
-          max_esdf[2], 2);
-    }
-  }
+  // squared distances of unreached voxels must stay finite in the storage type between passes
+  const double kGridScalarMax = std::numeric_limits<GridScalar>::max();
 
-  for (int x = min_esdf[0]; x <= max_esdf[0]; x++) {
-    for (int z = min_esdf[2]; z <= max_esdf[2]; z++) {
-      fillESDF([&](int y) { return md_.tmp_buffer1_[toAddress(x, y, z)]; },
-               [&](int y, double val) { md_.tmp_buffer2_[toAddress(x, y, z)] = val; }, min_esdf[1],
-               max_esdf[1], 1);
-    }
-  }
+  fillESDFPass(
+      [&](int adr) {
+        return getInflateBit(adr) ? 0 : std::numeric_limits<double>::max();
+      },
+      [&](int adr, double val) { md_.tmp_buffer1_[adr] = min(val, kGridScalarMax); }, 2, serial);
+
+  fillESDFPass([&](int adr) { return md_.tmp_buffer1_[adr]; },
+               [&](int adr, double val) { md_.tmp_buffer2_[adr] = min(val, kGridScalarMax); }, 1, serial);
 
-  for (int y = min_esdf[1]; y <= max_esdf[1]; y++) {
-    for (int z = min_esdf[2]; z <= max_esdf[2]; z++) {
-      fillESDF([&](int x) { return md_.tmp_buffer2_[toAddress(x, y, z)]; },
-               [&](int x, double val) {
-                 md_.distance_buffer_[toAddress(x, y, z)] = mp_.resolution_ * std::sqrt(val);
-                 //  min(mp_.resolution_ * std::sqrt(val),
-                 //      md_.distance_buffer_[toAddress(x, y, z)]);
+  fillESDFPass([&](int adr) { return md_.tmp_buffer2_[adr]; },
+               [&](int adr, double val) {
+                 md_.distance_buffer_[adr] = mp_.resolution_ * std::sqrt(val);
                },
-               min_esdf[0], max_esdf[0], 0);
-    }
-  }
+               0, serial);
 
   /* ========== compute negative distance ========== */
+  runESDFTask(max_esdf(0) - min_esdf(0) + 1, [&](int, int begin, int end) {
+    for (int x = min_esdf(0) + begin; x < min_esdf(0) + end; ++x)
+      for (int y = min_esdf(1); y <= max_esdf(1); ++y)
+        for (int z = min_esdf(2); z <= max_esdf(2); ++z) {
+
+          int idx = toAddress(x, y, z);
+          md_.occupancy_buffer_neg[idx] = getInflateBit(idx) ? 0 : 1;
+        }
+  }, serial);
+
+  fillESDFPass(
+      [&](int adr) {
+        return md_.occupancy_buffer_neg[adr] == 1 ? 0 : std::numeric_limits<double>::max();
+      },
+      [&](int adr, double val) { md_.tmp_buffer1_[adr] = min(val, kGridScalarMax); }, 2, serial);
+
+  fillESDFPass([&](int adr) { return md_.tmp_buffer1_[adr]; },
+               [&](int adr, double val) { md_.tmp_buffer2_[adr] = min(val, kGridScalarMax); }, 1, serial);
+
+  fillESDFPass([&](int adr) { return md_.tmp_buffer2_[adr]; },
+               [&](int adr, double val) {
+                 md_.distance_buffer_neg_[adr] = mp_.resolution_ * std::sqrt(val);
+               },
+               0, serial);
+
+  /* ========== combine pos and neg DT ========== */
+#if GRID_MAP_BRICKED_LAYOUT
+  runESDFTask(max_esdf(0) - min_esdf(0) + 1, [&](int, int begin, int end) {
+    for (int x = min_esdf(0) + begin; x < min_esdf(0) + end; ++x)
+      for (int y = min_esdf(1); y <= max_esdf(1); ++y)
+        for (int z = min_esdf(2); z <= max_esdf(2); ++z) {
+
+          int idx = toAddress(x, y, z);
+          md_.distance_buffer_all_[idx] = md_.distance_buffer_[idx];
+
+          if (md_.distance_buffer_neg_[idx] > 0.0)
+            md_.distance_buffer_all_[idx] += (-md_.distance_buffer_neg_[idx] + mp_.resolution_);
+        }
+  }, serial);
+#else
+  // z runs are contiguous, so each one is combined as a single vectorized expression
+  typedef Eigen::Array<GridScalar, Eigen::Dynamic, 1> GridArray;
+  const int z_len = max_esdf(2) - min_esdf(2) + 1;
+  runESDFTask(max_esdf(0) - min_esdf(0) + 1, [&](int, int begin, int end) {
+    for (int x = min_esdf(0) + begin; x < min_esdf(0) + end; ++x)
+      for (int y = min_esdf(1); y <= max_esdf(1); ++y) {
+        int z = min_esdf(2);
+        int idx = toAddress(x, y, z);
+        Eigen::Map<const GridArray> pos(&md_.distance_buffer_[idx], z_len);
+        Eigen::Map<const GridArray> neg(&md_.distance_buffer_neg_[idx], z_len);
+        Eigen::Map<GridArray> all(&md_.distance_buffer_all_[idx], z_len);
+
+        all = (neg > GridScalar(0)).select(pos + (GridScalar(mp_.resolution_) - neg), pos);
+      }
+  }, serial);
+#endif
+
+}
+
+void GridMap::checkESDFAgainstSerial()
+{
+  Eigen::Vector3i min_esdf = md_.min_esdf_;
+  Eigen::Vector3i max_esdf = md_.max_esdf_;
+
+  vector<double> parallel_dist;
+  parallel_dist.reserve((max_esdf - min_esdf + Eigen::Vector3i::Ones()).prod());
   for (int x = min_esdf(0); x <= max_esdf(0); ++x)
     for (int y = min_esdf(1); y <= max_esdf(1); ++y)
-      for (int z = min_esdf(2); z <= max_esdf(2); ++z) {
+      for (int z = min_esdf(2); z <= max_esdf(2); ++z)
+        parallel_dist.push_back(md_.distance_buffer_all_[toAddress(x, y, z)]);
 
-        int idx = toAddress(x, y, z);
-        if (md_.occupancy_buffer_inflate_[idx] == 0) {
-          md_.occupancy_buffer_neg[idx] = 1;
-        } else if (( md_.occupancy_buffer_inflate_[idx] == 1 )) {
-          md_.occupancy_buffer_neg[idx] = 0;
-        } else {
-          ROS_ERROR("what?");
+  updateESDF3d(true);
+
+  int mismatch = 0, i = 0;
+  double max_err = 0.0;
+  for (int x = min_esdf(0); x <= max_esdf(0); ++x)
+    for (int y = min_esdf(1); y <= max_esdf(1); ++y)
+      for (int z = min_esdf(2); z <= max_esdf(2); ++z, ++i)
+      {
+        double err = fabs(parallel_dist[i] - md_.distance_buffer_all_[toAddress(x, y, z)]);
+        if (err > 0.0)
+        {
+          ++mismatch;
+          max_err = max(max_err, err);
         }
       }
 
-  ros::Time t1, t2;
+  if (mismatch > 0)
+    ROS_ERROR("parallel esdf differs from serial at %d voxels, max error = %f", mismatch, max_err);
+}
 
-  for (int x = min_esdf[0]; x <= max_esdf[0]; x++) {
-    for (int y = min_esdf[1]; y <= max_esdf[1]; y++) {
-      fillESDF(
-          [&](int z) {
-            return md_.occupancy_buffer_neg[x * mp_.map_voxel_num_(1) * mp_.map_voxel_num_(2) +
-                                            y * mp_.map_voxel_num_(2) + z] == 1 ?
-                0 :
-                std::numeric_limits<double>::max();
-          },
-          [&](int z, double val) { md_.tmp_buffer1_[toAddress(x, y, z)] = val; }, min_esdf[2],
-          max_esdf[2], 2);
-    }
-  }
+void GridMap::markESDFDirty(Eigen::Vector3i min_id, Eigen::Vector3i max_id)
+{
+  boundIndex(min_id);
+  boundIndex(max_id);
 
-  for (int x = min_esdf[0]; x <= max_esdf[0]; x++) {
-    for (int z = min_esdf[2]; z <= max_esdf[2]; z++) {
-      fillESDF([&](int y) { return md_.tmp_buffer1_[toAddress(x, y, z)]; },
-               [&](int y, double val) { md_.tmp_buffer2_[toAddress(x, y, z)] = val; }, min_esdf[1],
-               max_esdf[1], 1);
-    }
+  if (md_.esdf_dirty_)
+  {
+    md_.esdf_dirty_min_ = md_.esdf_dirty_min_.cwiseMin(min_id);
+    md_.esdf_dirty_max_ = md_.esdf_dirty_max_.cwiseMax(max_id);
   }
+  else
+  {
+    md_.esdf_dirty_min_ = min_id;
+    md_.esdf_dirty_max_ = max_id;
+    md_.esdf_dirty_ = true;
+  }
+}
 
-  for (int y = min_esdf[1]; y <= max_esdf[1]; y++) {
-    for (int z = min_esdf[2]; z <= max_esdf[2]; z++) {
-      fillESDF([&](int x) { return md_.tmp_buffer2_[toAddress(x, y, z)]; },
-               [&](int x, double val) {
-                 md_.distance_buffer_neg_[toAddress(x, y, z)] = mp_.resolution_ * std::sqrt(val);
-               },
-               min_esdf[0], max_esdf[0], 0);
+int GridMap::updateESDFScanlines(const Eigen::Vector3i &min_dirty, const Eigen::Vector3i &max_dirty)
+{
+  /* The passes of updateESDF3d on both layers, restricted to the scanlines that can see a voxel of
+     the dirty box: the z columns through it, the y scanlines through its x range and the x scanlines
+     whose y pass result changed. Each scanline still spans the whole window, so the result is the
+     same as recomputing everything. Returns the number of redone x scanlines. */
+  const Eigen::Vector3i min_esdf = md_.min_esdf_;
+  const Eigen::Vector3i max_esdf = md_.max_esdf_;
+  const double kGridScalarMax = std::numeric_limits<GridScalar>::max();
+  const int z_num = max_esdf(2) - min_esdf(2) + 1;
+  Eigen::Vector3i id;
+
+  // a box covering the whole window, as after a rebuild, redoes every row
+  bool all_rows = min_dirty == min_esdf && max_dirty == max_esdf;
+  md_.esdf_row_changed_.assign((max_esdf(1) - min_esdf(1) + 1) * z_num, all_rows ? 1 : 0);
+  auto set_and_flag = [&](vector<GridScalar> &buffer, int adr, double val) {
+    GridScalar v = min(val, kGridScalarMax);
+    if (v == buffer[adr])
+      return;
+    buffer[adr] = v;
+    addressToIndex(adr, id);
+    md_.esdf_row_changed_[(id(1) - min_esdf(1)) * z_num + id(2) - min_esdf(2)] = 1;
+  };
+
+  /* ========== z pass of the dirty columns ========== */
+  for (int x = min_dirty(0); x <= max_dirty(0); ++x)
+    for (int y = min_dirty(1); y <= max_dirty(1); ++y)
+    {
+      for (int z = min_dirty(2); z <= max_dirty(2); ++z)
+      {
+        int idx = toAddress(x, y, z);
+        md_.occupancy_buffer_neg[idx] = getInflateBit(idx) ? 0 : 1;
+      }
+
+      Eigen::Vector3i column(x, y, 0);
+      fillESDFScanline(
+          [&](int adr) { return getInflateBit(adr) ? 0 : std::numeric_limits<double>::max(); },
+          [&](int adr, double val) { md_.tmp_buffer1_[adr] = min(val, kGridScalarMax); }, column, 2, 0);
+      fillESDFScanline(
+          [&](int adr) { return md_.occupancy_buffer_neg[adr] == 1 ? 0 : std::numeric_limits<double>::max(); },
+          [&](int adr, double val) { md_.tmp_buffer_neg1_[adr] = min(val, kGridScalarMax); }, column, 2, 0);
     }
-  }
 
-  /* ========== combine pos and neg DT ========== */
-  for (int x = min_esdf(0); x <= max_esdf(0); ++x)
-    for (int y = min_esdf(1); y <= max_esdf(1); ++y)
-      for (int z = min_esdf(2); z <= max_esdf(2); ++z) {
+  /* ========== y pass through the dirty x range ========== */
+  for (int x = min_dirty(0); x <= max_dirty(0); ++x)
+    for (int z = min_esdf(2); z <= max_esdf(2); ++z)
+    {
+      Eigen::Vector3i line(x, 0, z);
+      fillESDFScanline([&](int adr) { return md_.tmp_buffer1_[adr]; },
+                       [&](int adr, double val) { set_and_flag(md_.tmp_buffer2_, adr, val); }, line, 1, 0);
+      fillESDFScanline([&](int adr) { return md_.tmp_buffer_neg1_[adr]; },
+                       [&](int adr, double val) { set_and_flag(md_.tmp_buffer_neg2_, adr, val); }, line, 1, 0);
+    }
 
+  /* ========== x pass and combine of the changed rows ========== */
+  int redone = 0;
+  for (int y = min_esdf(1); y <= max_esdf(1); ++y)
+    for (int z = min_esdf(2); z <= max_esdf(2); ++z)
+    {
+      if (!md_.esdf_row_changed_[(y - min_esdf(1)) * z_num + z - min_esdf(2)])
+        continue;
+      ++redone;
+
+      Eigen::Vector3i row(0, y, z);
+      fillESDFScanline([&](int adr) { return md_.tmp_buffer2_[adr]; },
+                       [&](int adr, double val) { md_.distance_buffer_[adr] = mp_.resolution_ * std::sqrt(val); },
+                       row, 0, 0);
+      fillESDFScanline([&](int adr) { return md_.tmp_buffer_neg2_[adr]; },
+                       [&](int adr, double val) { md_.distance_buffer_neg_[adr] = mp_.resolution_ * std::sqrt(val); },
+                       row, 0, 0);
+
+      // same arithmetic as the combine of updateESDF3d in this layout
+      for (int x = min_esdf(0); x <= max_esdf(0); ++x)
+      {
         int idx = toAddress(x, y, z);
+#if GRID_MAP_BRICKED_LAYOUT
         md_.distance_buffer_all_[idx] = md_.distance_buffer_[idx];
-
         if (md_.distance_buffer_neg_[idx] > 0.0)
           md_.distance_buffer_all_[idx] += (-md_.distance_buffer_neg_[idx] + mp_.resolution_);
+#else
+        GridScalar pos = md_.distance_buffer_[idx], neg = md_.distance_buffer_neg_[idx];
+        md_.distance_buffer_all_[idx] = neg > GridScalar(0) ? pos + (GridScalar(mp_.resolution_) - neg) : pos;
+#endif
       }
+    }
 
+  return redone;
+}
+
+void GridMap::updateESDFIncremental()
+{
+  Eigen::Vector3i odom_index;
+  posToIndex(md_.camera_pos_, odom_index);
+
+  /* the window only follows the camera once it drifted past the margin, then it is recomputed whole */
+  if (!md_.esdf_inc_ready_ ||
+      (odom_index - md_.esdf_center_).cwiseAbs().maxCoeff() > mp_.esdf_recenter_margin_)
+  {
+    Eigen::Vector3i min_esdf = md_.min_esdf_;
+    Eigen::Vector3i max_esdf = md_.max_esdf_;
+    for (int x = min_esdf[0]; x <= max_esdf[0]; x++)
+      for (int y = min_esdf[1]; y <= max_esdf[1]; y++)
+        for (int z = min_esdf[2]; z <= max_esdf[2]; z++)
+        {
+          int idr = toAddress(x, y, z);
+          md_.tmp_buffer1_[idr] = md_.tmp_buffer2_[idr] = 0;
+          md_.tmp_buffer_neg1_[idr] = md_.tmp_buffer_neg2_[idr] = 0;
+          md_.distance_buffer_[idr] = 0;
+          md_.distance_buffer_all_[idr] = 0;
+          md_.distance_buffer_neg_[idr] = 0;
+          md_.occupancy_buffer_neg[idr] = 0;
+        }
+
+    md_.esdf_center_ = odom_index;
+    md_.min_esdf_ = odom_index - Eigen::Vector3i(mp_.esdf_x_bound_, mp_.esdf_y_bound_, mp_.esdf_z_bound_);
+    md_.max_esdf_ = odom_index + Eigen::Vector3i(mp_.esdf_x_bound_, mp_.esdf_y_bound_, mp_.esdf_z_bound_);
+    boundIndex(md_.min_esdf_);
+    boundIndex(md_.max_esdf_);
+    md_.esdf_inc_ready_ = true;
+    md_.esdf_dirty_ = false;
+
+    updateESDFScanlines(md_.min_esdf_, md_.max_esdf_);
+
+    if (mp_.show_occ_time_)
+      ROS_WARN("ESDF: rebuilt window of %d voxels",
+               (md_.max_esdf_ - md_.min_esdf_ + Eigen::Vector3i::Ones()).prod());
+    return;
+  }
+
+  if (!md_.esdf_dirty_) return;
+
+  Eigen::Vector3i min_dirty = md_.esdf_dirty_min_.cwiseMax(md_.min_esdf_);
+  Eigen::Vector3i max_dirty = md_.esdf_dirty_max_.cwiseMin(md_.max_esdf_);
+  md_.esdf_dirty_ = false;
+
+  if ((min_dirty.array() > max_dirty.array()).any()) return;
+
+  int redone = updateESDFScanlines(min_dirty, max_dirty);
+
+  if (mp_.show_occ_time_)
+    ROS_WARN("ESDF: incremental update redid %d of %d x scanlines", redone,
+             (md_.max_esdf_(1) - md_.min_esdf_(1) + 1) * (md_.max_esdf_(2) - md_.min_esdf_(2) + 1));
 }
 
 void GridMap::updateESDFCallback(const ros::TimerEvent & /*event*/)
 {
   if (!md_.esdf_need_update_) return;
 
-  /* esdf */
+  updateESDF();
+
+  md_.esdf_need_update_ = false;
+}
+
+void GridMap::updateESDF()
+{
   ros::Time t1, t2;
   t1 = ros::Time::now();
 
-  updateESDF3d();
+  if (mp_.esdf_incremental_)
+    updateESDFIncremental();
+  else
+    updateESDF3d();
 
   t2 = ros::Time::now();
 
-  // ROS_WARN("ESDF: cur t = %lf, avg t = %lf, max t = %lf", (t2 - t1).toSec());
+  if (mp_.show_occ_time_)
+    ROS_WARN("ESDF: t = %lf, threads = %d", (t2 - t1).toSec(), mp_.esdf_threads_);
 
-  md_.esdf_need_update_ = false;
+  if (mp_.esdf_check_serial_ && esdf_pool_ && !mp_.esdf_incremental_)
+    checkESDFAgainstSerial();
 }
 void GridMap::visCallback(const ros::TimerEvent & /*event*/)
 {
@@ -890,29 +1320,33 @@ void GridMap::updateOccupancyCallback(const ros::TimerEvent & /*event*/)
   }
   md_.last_occ_update_time_ = ros::Time::now();
 
+  if (mp_.rolling_map_)
+    rollMap(md_.camera_pos_);
+
   /* update occupancy */
-  // ros::Time t1, t2, t3, t4;
-  // t1 = ros::Time::now();
+  ros::Time t1, t2, t3, t4;
+  t1 = ros::Time::now();
 
   projectDepthImage();
-  // t2 = ros::Time::now();
+  t2 = ros::Time::now();
   raycastProcess();
-  // t3 = ros::Time::now();
+  t3 = ros::Time::now();
 
   if (md_.local_updated_)
     clearAndInflateLocalMap();
 
-  // t4 = ros::Time::now();
-
-  // cout << setprecision(7);
-  // cout << "t2=" << (t2-t1).toSec() << " t3=" << (t3-t2).toSec() << " t4=" << (t4-t3).toSec() << endl;;
+  t4 = ros::Time::now();
 
-  // md_.fuse_time_ += (t2 - t1).toSec();
-  // md_.max_fuse_time_ = max(md_.max_fuse_time_, (t2 - t1).toSec());
+  md_.fuse_time_ += (t3 - t1).toSec();
+  md_.max_fuse_time_ = max(md_.max_fuse_time_, (t3 - t1).toSec());
 
-  // if (mp_.show_occ_time_)
-  //   ROS_WARN("Fusion: cur t = %lf, avg t = %lf, max t = %lf", (t2 - t1).toSec(),
-  //            md_.fuse_time_ / md_.update_num_, md_.max_fuse_time_);
+  if (mp_.show_occ_time_)
+  {
+    ROS_WARN("Fusion: project t = %lf, raycast t = %lf, inflate t = %lf", (t2 - t1).toSec(),
+             (t3 - t2).toSec(), (t4 - t3).toSec());
+    ROS_WARN("Fusion: cur t = %lf, avg t = %lf, max t = %lf", (t3 - t1).toSec(),
+             md_.fuse_time_ / max(1, md_.update_num_), md_.max_fuse_time_);
+  }
 
   md_.freespace_need_update_ = true;
   md_.esdf_need_update_ = true;
@@ -970,10 +1404,6 @@ void GridMap::odomCallback(const nav_msgs::OdometryConstPtr &odom)
 
 void GridMap::cloudCallback(const sensor_msgs::PointCloud2ConstPtr &img)
 {
-
-  pcl::PointCloud<pcl::PointXYZ> latest_cloud;
-  pcl::fromROSMsg(*img, latest_cloud);
-
   md_.has_cloud_ = true;
 
   if (!md_.has_odom_)
@@ -982,96 +1412,82 @@ void GridMap::cloudCallback(const sensor_msgs::PointCloud2ConstPtr &img)
     return;
   }
 
-  if (latest_cloud.points.size() == 0)
+  if (img->width * img->height == 0)
     return;
 
   if (isnan(md_.camera_pos_(0)) || isnan(md_.camera_pos_(1)) || isnan(md_.camera_pos_(2)))
     return;
 
+  if (mp_.rolling_map_)
+    rollMap(md_.camera_pos_);
+
   this->resetBuffer(md_.camera_pos_ - mp_.local_update_range_,
                     md_.camera_pos_ + mp_.local_update_range_);
 
-  pcl::PointXYZ pt;
-  Eigen::Vector3d p3d, p3d_inf;
+  Eigen::Vector3d p3d;
+  Eigen::Vector3i cam_id, box_origin, id;
+  posToIndex(md_.camera_pos_, cam_id);
+  box_origin = cam_id - cloud_box_num_ / 2;
 
-  int inf_step = ceil(mp_.obstacles_inflation_ / mp_.resolution_);
-  int inf_step_z = 1;
-
-  double max_x, max_y, max_z, min_x, min_y, min_z;
+  /* quantize the points inside update range straight from the message, each voxel once */
+  cloud_voxels_.clear();
 
-  min_x = mp_.map_max_boundary_(0);
-  min_y = mp_.map_max_boundary_(1);
-  min_z = mp_.map_max_boundary_(2);
-
-  max_x = mp_.map_min_boundary_(0);
-  max_y = mp_.map_min_boundary_(1);
-  max_z = mp_.map_min_boundary_(2);
-
-  for (size_t i = 0; i < latest_cloud.points.size(); ++i)
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(*img, "x"), iter_y(*img, "y"), iter_z(*img, "z");
+  for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z)
   {
-    pt = latest_cloud.points[i];
-    p3d(0) = pt.x, p3d(1) = pt.y, p3d(2) = pt.z;
+    p3d(0) = *iter_x, p3d(1) = *iter_y, p3d(2) = *iter_z;
 
-    /* point inside update range */
     Eigen::Vector3d devi = p3d - md_.camera_pos_;
-    Eigen::Vector3i inf_pt;
-
-    if (fabs(devi(0)) < mp_.local_update_range_(0) && fabs(devi(1)) < mp_.local_update_range_(1) &&
-        fabs(devi(2)) < mp_.local_update_range_(2))
-    {
-
-      /* inflate the point */
-      for (int x = -inf_step; x <= inf_step; ++x)
-        for (int y = -inf_step; y <= inf_step; ++y)
-          for (int z = -inf_step_z; z <= inf_step_z; ++z)
-          {
-
-            p3d_inf(0) = pt.x + x * mp_.resolution_;
-            p3d_inf(1) = pt.y + y * mp_.resolution_;
-            p3d_inf(2) = pt.z + z * mp_.resolution_;
+    if (!(fabs(devi(0)) < mp_.local_update_range_(0) && fabs(devi(1)) < mp_.local_update_range_(1) &&
+          fabs(devi(2)) < mp_.local_update_range_(2)))
+      continue;
 
-            max_x = max(max_x, p3d_inf(0));
-            max_y = max(max_y, p3d_inf(1));
-            max_z = max(max_z, p3d_inf(2));
+    posToIndex(p3d, id);
+    Eigen::Vector3i box_id = id - box_origin;
+    char &flag = cloud_flag_[(box_id(0) * cloud_box_num_(1) + box_id(1)) * cloud_box_num_(2) + box_id(2)];
+    if (flag)
+      continue;
+    flag = 1;
+    cloud_voxels_.push_back(id);
+  }
 
-            min_x = min(min_x, p3d_inf(0));
-            min_y = min(min_y, p3d_inf(1));
-            min_z = min(min_z, p3d_inf(2));
+  /* inflate the voxels */
+  Eigen::Vector3i bound_min = cam_id, bound_max = cam_id;
 
-            posToIndex(p3d_inf, inf_pt);
+  for (const Eigen::Vector3i &vox : cloud_voxels_)
+  {
+    Eigen::Vector3i box_id = vox - box_origin;
+    cloud_flag_[(box_id(0) * cloud_box_num_(1) + box_id(1)) * cloud_box_num_(2) + box_id(2)] = 0;
 
-            if (!isInMap(inf_pt))
-              continue;
+    bound_min = bound_min.cwiseMin(vox + inf_stencil_.front());
+    bound_max = bound_max.cwiseMax(vox + inf_stencil_.back());
 
-            int idx_inf = toAddress(inf_pt);
+    for (const Eigen::Vector3i &offset : inf_stencil_)
+    {
+      id = vox + offset;
+      if (!isInMap(id))
+        continue;
 
-            md_.occupancy_buffer_inflate_[idx_inf] = 1;
-          }
+      setInflateBit(toAddress(id), true);
     }
   }
 
-  min_x = min(min_x, md_.camera_pos_(0));
-  min_y = min(min_y, md_.camera_pos_(1));
-  min_z = min(min_z, md_.camera_pos_(2));
+  bound_max(2) = max(bound_max(2), int(floor((mp_.ground_height_ - mp_.map_origin_(2)) * mp_.resolution_inv_)));
 
-  max_x = max(max_x, md_.camera_pos_(0));
-  max_y = max(max_y, md_.camera_pos_(1));
-  max_z = max(max_z, md_.camera_pos_(2));
-
-  max_z = max(max_z, mp_.ground_height_);
-
-  posToIndex(Eigen::Vector3d(max_x, max_y, max_z), md_.local_bound_max_);
-  posToIndex(Eigen::Vector3d(min_x, min_y, min_z), md_.local_bound_min_);
+  md_.local_bound_min_ = bound_min;
+  md_.local_bound_max_ = bound_max;
 
   boundIndex(md_.local_bound_min_);
   boundIndex(md_.local_bound_max_);
 
+  markESDFDirty(md_.local_bound_min_, md_.local_bound_max_);
+
   // add virtual ceiling to limit flight height
   if (mp_.virtual_ceil_height_ > -0.5) {
     int ceil_id = floor((mp_.virtual_ceil_height_ - mp_.map_origin_(2)) * mp_.resolution_inv_);
     for (int x = md_.local_bound_min_(0); x <= md_.local_bound_max_(0); ++x)
       for (int y = md_.local_bound_min_(1); y <= md_.local_bound_max_(1); ++y) {
-        md_.occupancy_buffer_inflate_[toAddress(x, y, ceil_id)] = 1;
+        setInflateBit(toAddress(x, y, ceil_id), true);
       }
   }
 }
@@ -1254,9 +1670,13 @@ void GridMap::publishMapInflate(bool all_info)
 
   for (int x = min_cut(0); x <= max_cut(0); ++x)
     for (int y = min_cut(1); y <= max_cut(1); ++y)
+    {
+      if (!isInflateSegmentOccupied(x, y, min_cut(2), max_cut(2)))
+        continue;
+
       for (int z = min_cut(2); z <= max_cut(2); ++z)
       {
-        if (md_.occupancy_buffer_inflate_[toAddress(x, y, z)] == 0)
+        if (!getInflateBit(toAddress(x, y, z)))
           continue;
 
         Eigen::Vector3d pos;
@@ -1269,6 +1689,7 @@ void GridMap::publishMapInflate(bool all_info)
         pt.z = pos(2);
         cloud.push_back(pt);
       }
+    }
 
   cloud.width = cloud.points.size();
   cloud.height = 1;
@@ -1346,6 +1767,126 @@ void GridMap::depthOdomCallback(const sensor_msgs::ImageConstPtr &img,
   md_.flag_use_depth_fusion = true;
 }
 
+bool GridMap::isBallFree(const Eigen::Vector3d& center, double radius)
+{
+  // a point of the ball and the nearest obstacle are each up to half a voxel diagonal from their voxel centers
+  const double reach = radius + sqrt(3.0) * mp_.resolution_;
+
+  Eigen::Vector3i min_id, max_id, center_id;
+  posToIndex(center - Eigen::Vector3d::Constant(reach), min_id);
+  posToIndex(center + Eigen::Vector3d::Constant(reach), max_id);
+
+  /* obstacles outside the ESDF window are not seen by it */
+  if ((min_id.array() < md_.min_esdf_.array()).any() || (max_id.array() > md_.max_esdf_.array()).any())
+    return false;
+
+  /* occupancy changed here after the last ESDF update */
+  if (md_.esdf_dirty_ && (min_id.array() <= md_.esdf_dirty_max_.array()).all() &&
+      (max_id.array() >= md_.esdf_dirty_min_.array()).all())
+    return false;
+
+  posToIndex(center, center_id);
+  return md_.distance_buffer_[toAddress(center_id)] > reach;
+}
+
+bool GridMap::isInflateBoxOccupied(const Eigen::Vector3i& min_id, const Eigen::Vector3i& max_id)
+{
+  for (int x = min_id(0); x <= max_id(0); ++x)
+    for (int y = min_id(1); y <= max_id(1); ++y)
+      if (isInflateSegmentOccupied(x, y, min_id(2), max_id(2)))
+        return true;
+
+  return false;
+}
+
+bool GridMap::isBoxFree(const Eigen::Vector3d& min_pos, const Eigen::Vector3d& max_pos)
+{
+  Eigen::Vector3i min_id, max_id;
+  posToIndex(min_pos, min_id);
+  posToIndex(max_pos, max_id);
+
+  if (!isInMap(min_id) || !isInMap(max_id))
+    return false;
+
+  return !isInflateBoxOccupied(min_id, max_id);
+}
+
+bool GridMap::isSegmentFree(const Eigen::Vector3d& p1, const Eigen::Vector3d& p2, bool use_esdf)
+{
+  Eigen::Vector3i id, end_id;
+  posToIndex(p2, end_id);
+
+  const Eigen::Vector3d dir = p2 - p1;
+  const double len = dir.norm();
+  const Eigen::Vector3d u = len > 1e-9 ? Eigen::Vector3d(dir / len) : Eigen::Vector3d::Zero();
+  const double skip_margin = sqrt(3.0) * mp_.resolution_;
+
+  /* DDA in arc length s along the segment: t_max is where the next boundary on each axis is crossed */
+  Eigen::Vector3i step;
+  Eigen::Vector3d t_max, t_delta;
+  double s = 0;
+  auto startAt = [&](double s0) {
+    s = s0;
+    Eigen::Vector3d p = p1 + s * u;
+    posToIndex(p, id);
+    for (int i = 0; i < 3; ++i)
+    {
+      step(i) = u(i) > 0 ? 1 : (u(i) < 0 ? -1 : 0);
+      if (step(i) == 0)
+      {
+        t_max(i) = t_delta(i) = std::numeric_limits<double>::infinity();
+        continue;
+      }
+      double boundary = mp_.map_origin_(i) + (id(i) + (step(i) > 0)) * mp_.resolution_;
+      t_max(i) = s + (boundary - p(i)) / u(i);
+      t_delta(i) = mp_.resolution_ / fabs(u(i));
+    }
+  };
+
+  startAt(0);
+  while (s <= len)
+  {
+    /* the z steps before the next x or y crossing stay in one column and are tested as one segment */
+    int z_last = id(2);
+    const bool end_column = id(0) == end_id(0) && id(1) == end_id(1);
+    while (!(end_column && z_last == end_id(2)) && t_max(2) < t_max(0) && t_max(2) < t_max(1) && t_max(2) <= len)
+    {
+      s = t_max(2);
+      z_last += step(2);
+      t_max(2) += t_delta(2);
+    }
+
+    Eigen::Vector3i last(id(0), id(1), z_last);
+    if (!isInMap(id) || !isInMap(last) ||
+        isInflateSegmentOccupied(id(0), id(1), min(id(2), z_last), max(id(2), z_last)))
+      return false;
+    id = last;
+
+    if (id == end_id)
+      return true;
+
+    if (use_esdf && (id.array() >= md_.min_esdf_.array()).all() && (id.array() <= md_.max_esdf_.array()).all())
+    {
+      double r = md_.distance_buffer_[toAddress(id)] - skip_margin - 1e-6;
+      if (r > 2 * mp_.resolution_ && isBallFree(p1 + s * u, r))
+      {
+        if (s + r >= len)
+          return true;
+        startAt(s + r);
+        continue;
+      }
+    }
+
+    int axis;
+    t_max.minCoeff(&axis);
+    s = t_max(axis);
+    id(axis) += step(axis);
+    t_max(axis) += t_delta(axis);
+  }
+
+  return true;
+}
+
 bool GridMap::evaluateESDF(const Eigen::Vector3d& pos,
                            double& dist) 
 {
@@ -1382,6 +1923,77 @@ bool GridMap::evaluateESDFWithGrad(const Eigen::Vector3d& pos,
   return true;
 }
 
+int GridMap::evaluateESDFWithGradBatch(const Eigen::Ref<const Eigen::Matrix3Xd>& pos, Eigen::VectorXd& dist,
+                                       Eigen::Matrix3Xd& grad, Eigen::VectorXi& valid)
+{
+  const int n = pos.cols();
+  dist.resize(n);
+  grad.resize(3, n);
+  valid.resize(n);
+  if (n == 0)
+    return 0;
+
+  /* lower interpolation corner and offset of every point, same arithmetic as getSurroundPts */
+  const Eigen::Array3d origin = mp_.map_origin_.array();
+  const Eigen::Array3Xd p = pos.array();
+  const Eigen::Array3Xi id = ((p.colwise() - origin) * mp_.resolution_inv_).floor().cast<int>();
+  const Eigen::Array3Xi id_m =
+      (((p - 0.5 * mp_.resolution_).colwise() - origin) * mp_.resolution_inv_).floor().cast<int>();
+  const Eigen::Array3Xd id_pos = ((id_m.cast<double>() + 0.5) * mp_.resolution_).colwise() + origin;
+  const Eigen::Array3Xd diff = (p - id_pos) * mp_.resolution_inv_;
+
+  /* one bounds check for the whole batch, clamping is only needed near the window border */
+  const Eigen::Array3i min_valid(md_.min_esdf_(0) + 2, md_.min_esdf_(1) + 2, md_.min_esdf_(2) + 1);
+  const Eigen::Array3i max_valid(md_.max_esdf_(0) - 2, md_.max_esdf_(1) - 2, md_.max_esdf_(2) - 1);
+  int valid_num = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    valid(i) = (id.col(i) >= min_valid).all() && (id.col(i) <= max_valid).all();
+    valid_num += valid(i);
+  }
+
+  const Eigen::Array3i min_corner = md_.min_esdf_.array();
+  const Eigen::Array3i max_corner = md_.max_esdf_.array() - 1;
+  const bool need_clamp = (id_m.rowwise().minCoeff() < min_corner).any() ||
+                          (id_m.rowwise().maxCoeff() + 1 > max_corner).any();
+
+  /* gather the eight corners into structure-of-arrays form */
+  Eigen::ArrayXd c[2][2][2];
+  for (int x = 0; x < 2; x++)
+    for (int y = 0; y < 2; y++)
+      for (int z = 0; z < 2; z++)
+      {
+        Eigen::ArrayXd &cv = c[x][y][z];
+        cv.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+          Eigen::Vector3i cid = (id_m.col(i) + Eigen::Array3i(x, y, z)).matrix();
+          if (need_clamp)
+            cid = cid.array().max(min_corner).min(max_corner).matrix();
+          cv(i) = md_.distance_buffer_all_[toAddress(cid)];
+        }
+      }
+
+  /* vectorized trilinear interpolation and gradient */
+  const Eigen::ArrayXd dx = diff.row(0).transpose(), dy = diff.row(1).transpose(), dz = diff.row(2).transpose();
+  const Eigen::ArrayXd v00 = (1 - dx) * c[0][0][0] + dx * c[1][0][0];
+  const Eigen::ArrayXd v01 = (1 - dx) * c[0][0][1] + dx * c[1][0][1];
+  const Eigen::ArrayXd v10 = (1 - dx) * c[0][1][0] + dx * c[1][1][0];
+  const Eigen::ArrayXd v11 = (1 - dx) * c[0][1][1] + dx * c[1][1][1];
+  const Eigen::ArrayXd v0 = (1 - dy) * v00 + dy * v10;
+  const Eigen::ArrayXd v1 = (1 - dy) * v01 + dy * v11;
+  const Eigen::ArrayXd mask = valid.array().cast<double>();
+
+  dist = (((1 - dz) * v0 + dz * v1) * mask).matrix();
+  grad.row(2) = ((v1 - v0) * mp_.resolution_inv_ * mask).matrix().transpose();
+  grad.row(1) = (((1 - dz) * (v10 - v00) + dz * (v11 - v01)) * mp_.resolution_inv_ * mask).matrix().transpose();
+  grad.row(0) = (((1 - dz) * (1 - dy) * (c[1][0][0] - c[0][0][0]) + (1 - dz) * dy * (c[1][1][0] - c[0][1][0]) +
+                  dz * (1 - dy) * (c[1][0][1] - c[0][0][1]) + dz * dy * (c[1][1][1] - c[0][1][1])) *
+                 mp_.resolution_inv_ * mask).matrix().transpose();
+
+  return valid_num;
+}
+
 void GridMap::getSurroundPts(const Eigen::Vector3d& pos, Eigen::Vector3d pts[2][2][2], Eigen::Vector3d& diff) 
 {                             
   /* interpolation position */
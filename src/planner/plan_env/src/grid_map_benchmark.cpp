@@ -0,0 +1,89 @@
+#include <ros/ros.h>
+#include <plan_env/grid_map.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+/* Times GridMap::updateESDF() and ESDF queries on a map of random boxes. The map is configured by
+   the usual grid_map/ parameters in the private namespace, see launch/grid_map_benchmark.launch.
+   Compare builds by running the same launch file against each of them, and esdf worker counts with
+   its esdf_threads argument. */
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "grid_map_benchmark");
+  ros::NodeHandle nh("~");
+
+  int rounds, obstacles, queries, seed, esdf_threads;
+  double query_range;
+  nh.param("benchmark/rounds", rounds, 20);
+  nh.param("benchmark/obstacles", obstacles, 300);
+  nh.param("benchmark/queries", queries, 100000);
+  nh.param("benchmark/query_range", query_range, 5.0);
+  nh.param("benchmark/seed", seed, 1);
+  nh.param("grid_map/esdf_threads", esdf_threads, 1);
+  rounds = max(rounds, 1);
+
+  GridMap grid_map;
+  grid_map.initMap(nh);
+
+  Eigen::Vector3d origin, size;
+  grid_map.getRegion(origin, size);
+  Eigen::Vector3d center = origin + 0.5 * size;
+  grid_map.setCameraPosition(center);
+
+  /* random boxes from 0.2 to 1.0 m wide, anywhere in the map */
+  default_random_engine eng(seed);
+  uniform_real_distribution<double> rand_unit(0.0, 1.0);
+  double res = grid_map.getResolution();
+
+  for (int i = 0; i < obstacles; ++i)
+  {
+    Eigen::Vector3d box_min, box_size;
+    for (int k = 0; k < 3; ++k)
+    {
+      box_size(k) = 0.2 + 0.8 * rand_unit(eng);
+      box_min(k) = origin(k) + (size(k) - box_size(k)) * rand_unit(eng);
+    }
+
+    for (double x = box_min(0); x < box_min(0) + box_size(0); x += res)
+      for (double y = box_min(1); y < box_min(1) + box_size(1); y += res)
+        for (double z = box_min(2); z < box_min(2) + box_size(2); z += res)
+          grid_map.setOccupied(Eigen::Vector3d(x, y, z));
+  }
+
+  /* esdf update, the whole window is recomputed every round */
+  vector<double> esdf_t;
+  for (int r = 0; r < rounds; ++r)
+  {
+    ros::WallTime t1 = ros::WallTime::now();
+    grid_map.updateESDF();
+    esdf_t.push_back((ros::WallTime::now() - t1).toSec());
+  }
+  sort(esdf_t.begin(), esdf_t.end());
+
+  /* queries within query_range of the window center, outside the esdf window they return early */
+  vector<Eigen::Vector3d> pts(queries);
+  for (Eigen::Vector3d &pt : pts)
+    for (int k = 0; k < 3; ++k)
+      pt(k) = center(k) + min(query_range, 0.5 * size(k)) * (2 * rand_unit(eng) - 1);
+
+  double dist, dist_sum = 0;
+  Eigen::Vector3d grad;
+  ros::WallTime t1 = ros::WallTime::now();
+  for (const Eigen::Vector3d &pt : pts)
+  {
+    grid_map.evaluateESDFWithGrad(pt, dist, grad);
+    dist_sum += dist;
+  }
+  double query_t = (ros::WallTime::now() - t1).toSec();
+
+  ROS_INFO("grid_map_benchmark: esdf update median = %lf ms, min = %lf ms over %d rounds, threads = %d",
+           esdf_t[esdf_t.size() / 2] * 1e3, esdf_t.front() * 1e3, rounds, esdf_threads);
+  ROS_INFO("grid_map_benchmark: esdf query = %lf us, checksum = %lf", query_t / max(queries, 1) * 1e6, dist_sum);
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <plan_env/grid_map.h>
+
+#include <random>
+
+namespace
+{
+
+void setMapParams(ros::NodeHandle &nh, bool incremental)
+{
+  nh.setParam("grid_map/resolution", 0.1);
+  nh.setParam("grid_map/map_size_x", 10.0);
+  nh.setParam("grid_map/map_size_y", 10.0);
+  nh.setParam("grid_map/map_size_z", 3.0);
+  nh.setParam("grid_map/local_update_range_x", 5.5);
+  nh.setParam("grid_map/local_update_range_y", 5.5);
+  nh.setParam("grid_map/local_update_range_z", 4.5);
+  nh.setParam("grid_map/obstacles_inflation", 0.099);
+  nh.setParam("grid_map/ground_height", -0.01);
+  nh.setParam("grid_map/esdf_x_bound", 30);
+  nh.setParam("grid_map/esdf_y_bound", 30);
+  nh.setParam("grid_map/esdf_z_bound", 10);
+  nh.setParam("grid_map/esdf_incremental", incremental);
+  nh.setParam("grid_map/esdf_recenter_margin", 5);
+}
+
+// writes the same random boxes into both maps, with clear_ratio of them freeing voxels again
+void setRandomBoxes(GridMap &map1, GridMap &map2, std::mt19937 &rng, int num, double clear_ratio)
+{
+  Eigen::Vector3d origin, size;
+  map1.getRegion(origin, size);
+  const double res = map1.getResolution();
+  std::uniform_real_distribution<double> rand_unit(0.0, 1.0);
+
+  for (int i = 0; i < num; ++i)
+  {
+    Eigen::Vector3d center, half;
+    for (int k = 0; k < 3; ++k)
+    {
+      center(k) = origin(k) + size(k) * rand_unit(rng);
+      half(k) = 0.3 * rand_unit(rng);
+    }
+    bool occ = rand_unit(rng) >= clear_ratio;
+
+    for (double x = center(0) - half(0); x <= center(0) + half(0); x += res)
+      for (double y = center(1) - half(1); y <= center(1) + half(1); y += res)
+        for (double z = center(2) - half(2); z <= center(2) + half(2); z += res)
+        {
+          map1.setOccupied(Eigen::Vector3d(x, y, z), occ);
+          map2.setOccupied(Eigen::Vector3d(x, y, z), occ);
+        }
+  }
+}
+
+// number of voxel centers where the two esdf windows or distances differ, the first one is reported
+int countESDFMismatches(GridMap &expected, GridMap &actual)
+{
+  Eigen::Vector3d origin, size;
+  expected.getRegion(origin, size);
+  const double res = expected.getResolution();
+  const Eigen::Vector3i voxel_num = (size / res).array().round().cast<int>();
+
+  int mismatches = 0;
+  for (int x = 0; x < voxel_num(0); ++x)
+    for (int y = 0; y < voxel_num(1); ++y)
+      for (int z = 0; z < voxel_num(2); ++z)
+      {
+        Eigen::Vector3d pos = origin + (Eigen::Vector3d(x, y, z) + Eigen::Vector3d::Constant(0.5)) * res;
+        if (expected.isInESDF(pos) != actual.isInESDF(pos) ||
+            (expected.isInESDF(pos) && expected.getDistance(pos) != actual.getDistance(pos)))
+        {
+          if (mismatches++ == 0)
+            ADD_FAILURE() << "esdf differs at " << pos.transpose() << ": " << expected.getDistance(pos) << " vs "
+                          << actual.getDistance(pos);
+        }
+      }
+
+  return mismatches;
+}
+
+}  // namespace
+
+TEST(GridMapTest, IncrementalESDFMatchesFullTransform)
+{
+  ros::NodeHandle nh_full("~full"), nh_incremental("~incremental");
+  setMapParams(nh_full, false);
+  setMapParams(nh_incremental, true);
+
+  GridMap full, incremental;
+  full.initMap(nh_full);
+  incremental.initMap(nh_incremental);
+
+  // the later camera positions are past the recenter margin, so the incremental window is rebuilt
+  const Eigen::Vector3d cameras[] = {Eigen::Vector3d(0.05, 0.05, 1.05), Eigen::Vector3d(1.05, -0.75, 1.25),
+                                     Eigen::Vector3d(-0.45, 0.35, 1.05)};
+  std::mt19937 rng(1);
+
+  for (const Eigen::Vector3d &camera : cameras)
+  {
+    full.setCameraPosition(camera);
+    incremental.setCameraPosition(camera);
+
+    for (int step = 0; step < 8; ++step)
+    {
+      setRandomBoxes(full, incremental, rng, 40, step == 0 ? 0.0 : 0.4);
+      full.updateESDF();
+      incremental.updateESDF();
+
+      EXPECT_EQ(countESDFMismatches(full, incremental), 0) << "camera " << camera.transpose() << ", step " << step;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_grid_map");
+  return RUN_ALL_TESTS();
+}
@@ -52,6 +52,9 @@ namespace ego_planner
     double getSwarmClearance(void) { return bspline_optimizer_->getSwarmClearance(); }
 
     bool checkCollision(int drone_id);
+    // earliest t in [t_start, t_end) where traj hits an inflated obstacle (or leaves the map), or comes closer
+    // than the swarm clearance to another drone at the same moment; false if there is none
+    bool sweepTrajCollision(UniformBspline &traj, const ros::Time &traj_start_time, double t_start, double t_end, double &t_collide);
     void get_track_line( double t_cur, double t_max, double dt, double start_time_ros, std::vector<Eigen::Vector3d> &attract_lines );
     void angleLimite( double &angle );
 
@@ -69,6 +72,10 @@ namespace ego_planner
     /* main planning algorithms & modules */
     PlanningVisualization::Ptr visualization_;
 
+    // one optimizer (with its own A*) per pool thread for the distinctive candidates
+    unique_ptr<ThreadPool> candidate_pool_;
+    std::vector<BsplineOptimizer::Ptr> candidate_optimizers_;
+
     // ros::Publisher obj_pub_; //zx-todo 
 
 
@@ -78,7 +85,7 @@ namespace ego_planner
 
     void updateTrajInfo(const UniformBspline &position_traj, const ros::Time time_now);
 
-    void reparamBspline(UniformBspline &bspline, vector<Eigen::Vector3d> &start_end_derivative, double ratio, Eigen::MatrixXd &ctrl_pts, double &dt,
+    bool reparamBspline(UniformBspline &bspline, vector<Eigen::Vector3d> &start_end_derivative, double ratio, Eigen::MatrixXd &ctrl_pts, double &dt,
                         double &time_inc);
 
     bool refineTrajAlgo(UniformBspline &traj, vector<Eigen::Vector3d> &start_end_derivative, double ratio, double &ts, Eigen::MatrixXd &optimal_control_points);
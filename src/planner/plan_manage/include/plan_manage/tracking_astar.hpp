@@ -113,6 +113,21 @@ class KinodynamicAstar {
   /* ---------- record data ---------- */
   Eigen::Vector3d start_vel_, end_vel_, start_acc_;
   Eigen::Matrix<double, 6, 6> phi_;  // state transit matrix
+
+  /* ---------- motion primitives ---------- */
+  // Constant input um applied for tau from state [p; v] gives [p + t v + dp(t); v + dv(t)],
+  // so the offsets are computed once and every expansion only adds the current state.
+  struct MotionPrimitive {
+    Eigen::Vector3d input;
+    double tau;
+    double cost;  // (|um|^2 + w_time) * tau
+    Eigen::Vector3d dp_end, dv_end;
+    Eigen::VectorXd t_check;  // check_num safety samples in (0, tau]
+    Eigen::Matrix<double, 3, Eigen::Dynamic> dp_check, dv_check;
+  };
+  std::vector<MotionPrimitive> primitives_;       // regular expansion, fixed by the parameters
+  std::vector<MotionPrimitive> init_primitives_;  // first expansion, follows the start acceleration
+  std::unordered_map<long long, Eigen::Vector3d> target_pos_cache_;  // t in us -> tracked position
   GridMap::Ptr gridMapPtr_;
   bool is_shot_succ_ = false;
   Eigen::MatrixXd coef_shot_;
@@ -127,6 +142,7 @@ class KinodynamicAstar {
   int allocate_num_, check_num_;
   double tie_breaker_;
   bool optimistic_;
+  bool ray_use_esdf_;
 
   /* map */
   double resolution_, inv_resolution_, time_resolution_, inv_time_resolution_;
@@ -273,24 +289,79 @@ class KinodynamicAstar {
     state1 = phi_ * state0 + integral;
   }
 
+  void setPrimitive(const Eigen::Vector3d& um, double tau, MotionPrimitive& prim) {
+    prim.input = um;
+    prim.tau = tau;
+    prim.cost = (um.squaredNorm() + w_time_) * tau;
+    prim.dp_end = 0.5 * pow(tau, 2) * um;
+    prim.dv_end = tau * um;
+
+    prim.t_check.resize(check_num_);
+    prim.dp_check.resize(3, check_num_);
+    prim.dv_check.resize(3, check_num_);
+    for (int k = 1; k <= check_num_; ++k) {
+      double dt = tau * double(k) / double(check_num_);
+      prim.t_check(k - 1) = dt;
+      prim.dp_check.col(k - 1) = 0.5 * pow(dt, 2) * um;
+      prim.dv_check.col(k - 1) = dt * um;
+    }
+  }
+
+  void buildPrimitives() {
+    double res = 1 / 2.0, time_res = 1 / 1.0;
+    vector<Eigen::Vector3d> inputs;
+    vector<double> durations;
+    for (double ax = -max_acc_; ax <= max_acc_ + 1e-3; ax += max_acc_ * res)
+      for (double ay = -max_acc_; ay <= max_acc_ + 1e-3; ay += max_acc_ * res)
+        for (double az = -max_acc_; az <= max_acc_ + 1e-3;
+             az += max_acc_ * res)
+          inputs.push_back(Eigen::Vector3d(ax, ay, az));
+    for (double tau = time_res * max_tau_; tau <= max_tau_;
+         tau += time_res * max_tau_)
+      durations.push_back(tau);
+
+    primitives_.resize(inputs.size() * durations.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+      for (size_t j = 0; j < durations.size(); ++j)
+        setPrimitive(inputs[i], durations[j],
+                     primitives_[i * durations.size() + j]);
+  }
+
+  void buildInitPrimitives(const Eigen::Vector3d& start_acc) {
+    double time_res_init = 1 / 20.0;
+    init_primitives_.clear();
+    for (double tau = time_res_init * init_max_tau_;
+         tau <= init_max_tau_ + 1e-3; tau += time_res_init * init_max_tau_) {
+      init_primitives_.emplace_back();
+      setPrimitive(start_acc, tau, init_primitives_.back());
+    }
+  }
+
+  // siblings share their sample times, so the target positions are cached per search
+  const Eigen::Vector3d& targetPos(double t) {
+    long long key = llround(t * 1e6);
+    auto it = target_pos_cache_.find(key);
+    if (it == target_pos_cache_.end())
+      it = target_pos_cache_
+               .emplace(key, tracked_traj_.evaluateDeBoorT(key * 1e-6))
+               .first;
+    return it->second;
+  }
+
   bool rayValid(const Eigen::Vector3d& p1,
                 const Eigen::Vector3d& v,
                 const double t) {
     if (t > tracked_traj_.getTimeSum()) {
       return !gridMapPtr_->getInflateOccupancy(p1);
     }
-    Eigen::Vector3d p2 = tracked_traj_.evaluateDeBoorT(t);
+    const Eigen::Vector3d& p2 = targetPos(t);
     double dist = (p1 - p2).norm();
+    if (dist < resolution_)
+      return true;
 
-    int n = floor(dist / resolution_);
-    for (int i = 0; i < n; ++i) {
-      double lambda = 1.0 * i / n;
-      Eigen::Vector3d p = (1 - lambda) * p1 + lambda * p2;
-      if (gridMapPtr_->getInflateOccupancy(p)) {
-        return false;
-      }
-    }
-    return true;
+    // the last resolution_ before the target is not checked, the target itself may be in the map
+    return gridMapPtr_->isSegmentFree(
+        p1, p2 + (p1 - p2) * (resolution_ / dist), ray_use_esdf_);
   }
 
  public:
@@ -307,6 +378,7 @@ class KinodynamicAstar {
     nh.param("search/allocate_num", allocate_num_, -1);
     nh.param("search/check_num", check_num_, -1);
     nh.param("search/optimistic", optimistic_, true);
+    nh.param("search/ray_use_esdf", ray_use_esdf_, false);
     tie_breaker_ = 1.0 + 1.0 / 10000;
 
     double vel_margin;
@@ -334,6 +406,8 @@ class KinodynamicAstar {
     phi_ = Eigen::MatrixXd::Identity(6, 6);
     use_node_num_ = 0;
     iter_num_ = 0;
+
+    buildPrimitives();
   }
   ~KinodynamicAstar() {
     for (int i = 0; i < allocate_num_; i++) {
@@ -345,6 +419,7 @@ class KinodynamicAstar {
   void reset() {
     expanded_nodes_.clear();
     path_nodes_.clear();
+    target_pos_cache_.clear();
 
     std::priority_queue<PathNodePtr, std::vector<PathNodePtr>, NodeComparator>
         empty_queue;
@@ -370,12 +445,15 @@ class KinodynamicAstar {
              double time_start = 0.0) {
     ros::Time t_jlji = ros::Time::now();
     tracked_traj_ = traj;
+    target_pos_cache_.clear();
     Eigen::Vector3d end_pt =
         tracked_traj_.evaluateDeBoorT(tracked_traj_.getTimeSum());
     Eigen::Vector3d end_v = tracked_traj_.getDerivative().evaluateDeBoorT(
         tracked_traj_.getTimeSum());
     start_vel_ = start_v;
     start_acc_ = start_a;
+    if (init)
+      buildInitPrimitives(start_acc_);
 
     PathNodePtr cur_node = path_node_pool_[0];
     cur_node->parent = NULL;
@@ -434,170 +512,149 @@ class KinodynamicAstar {
       cur_node->node_state = IN_CLOSE_SET;
       iter_num_ += 1;
 
-      double res = 1 / 2.0, time_res = 1 / 1.0, time_res_init = 1 / 20.0;
-      Eigen::Matrix<double, 6, 1> cur_state = cur_node->state;
+      const Eigen::Vector3d cur_pos = cur_node->state.head(3);
+      const Eigen::Vector3d cur_vel = cur_node->state.tail(3);
       Eigen::Matrix<double, 6, 1> pro_state;
       vector<PathNodePtr> tmp_expand_nodes;
-      Eigen::Vector3d um;
       double pro_t;
-      vector<Eigen::Vector3d> inputs;
-      vector<double> durations;
-      if (init_search) {
-        inputs.push_back(start_acc_);
-        for (double tau = time_res_init * init_max_tau_;
-             tau <= init_max_tau_ + 1e-3; tau += time_res_init * init_max_tau_)
-          durations.push_back(tau);
-        init_search = false;
-      } else {
-        for (double ax = -max_acc_; ax <= max_acc_ + 1e-3; ax += max_acc_ * res)
-          for (double ay = -max_acc_; ay <= max_acc_ + 1e-3;
-               ay += max_acc_ * res)
-            for (double az = -max_acc_; az <= max_acc_ + 1e-3;
-                 az += max_acc_ * res) {
-              um << ax, ay, az;
-              inputs.push_back(um);
-            }
-        for (double tau = time_res * max_tau_; tau <= max_tau_;
-             tau += time_res * max_tau_)
-          durations.push_back(tau);
-      }
+      const vector<MotionPrimitive>& prims =
+          init_search ? init_primitives_ : primitives_;
+      init_search = false;
+
+      // cout << "cur state:" << cur_node->state.head(3).transpose() << endl;
+      for (const MotionPrimitive& prim : prims) {
+        const Eigen::Vector3d& um = prim.input;
+        double tau = prim.tau;
+        pro_state.head(3) = cur_pos + tau * cur_vel + prim.dp_end;
+        pro_state.tail(3) = cur_vel + prim.dv_end;
+        pro_t = cur_node->time + tau;
+
+        Eigen::Vector3d pro_pos = pro_state.head(3);
+
+        // Check if in close set
+        Eigen::Vector3i pro_id = posToIndex(pro_pos);
+        int pro_t_id = timeToIndex(pro_t);
+        PathNodePtr pro_node = dynamic
+                                   ? expanded_nodes_.find(pro_id, pro_t_id)
+                                   : expanded_nodes_.find(pro_id);
+        if (pro_node != NULL && pro_node->node_state == IN_CLOSE_SET) {
+          if (init_search)
+            std::cout << "close" << std::endl;
+          continue;
+        }
 
-      // cout << "cur state:" << cur_state.head(3).transpose() << endl;
-      for (int i = 0; i < (int)inputs.size(); ++i)
-        for (int j = 0; j < (int)durations.size(); ++j) {
-          um = inputs[i];
-          double tau = durations[j];
-          stateTransit(cur_state, pro_state, um, tau);
-          pro_t = cur_node->time + tau;
-
-          Eigen::Vector3d pro_pos = pro_state.head(3);
-
-          // Check if in close set
-          Eigen::Vector3i pro_id = posToIndex(pro_pos);
-          int pro_t_id = timeToIndex(pro_t);
-          PathNodePtr pro_node = dynamic
-                                     ? expanded_nodes_.find(pro_id, pro_t_id)
-                                     : expanded_nodes_.find(pro_id);
-          if (pro_node != NULL && pro_node->node_state == IN_CLOSE_SET) {
-            if (init_search)
-              std::cout << "close" << std::endl;
-            continue;
-          }
+        // Check maximal velocity
+        Eigen::Vector3d pro_v = pro_state.tail(3);
+        if (fabs(pro_v(0)) > max_vel_ || fabs(pro_v(1)) > max_vel_ ||
+            fabs(pro_v(2)) > max_vel_) {
+          if (init_search)
+            std::cout << "vel" << std::endl;
+          continue;
+        }
 
-          // Check maximal velocity
-          Eigen::Vector3d pro_v = pro_state.tail(3);
-          if (fabs(pro_v(0)) > max_vel_ || fabs(pro_v(1)) > max_vel_ ||
-              fabs(pro_v(2)) > max_vel_) {
-            if (init_search)
-              std::cout << "vel" << std::endl;
-            continue;
-          }
+        // Check not in the same voxel
+        Eigen::Vector3i diff = pro_id - cur_node->index;
+        int diff_time = pro_t_id - cur_node->time_idx;
+        if (diff.norm() == 0 && ((!dynamic) || diff_time == 0)) {
+          if (init_search)
+            std::cout << "same" << std::endl;
+          continue;
+        }
 
-          // Check not in the same voxel
-          Eigen::Vector3i diff = pro_id - cur_node->index;
-          int diff_time = pro_t_id - cur_node->time_idx;
-          if (diff.norm() == 0 && ((!dynamic) || diff_time == 0)) {
-            if (init_search)
-              std::cout << "same" << std::endl;
-            continue;
+        // Check safety
+        Eigen::Vector3d pos, vel;
+        bool is_occ = false;
+        for (int k = 0; k < check_num_; ++k) {
+          double dt = prim.t_check(k);
+          pos = cur_pos + dt * cur_vel + prim.dp_check.col(k);
+          vel = cur_vel + prim.dv_check.col(k);
+          // TODO check cur_node->time + dt
+          // if (gridMapPtr_->getInflateOccupancy(pos) == 1) {
+          if (!rayValid(pos, vel, cur_node->time + dt)) {
+            is_occ = true;
+            break;
           }
+        }
+        if (is_occ) {
+          if (init_search)
+            std::cout << "safe" << std::endl;
+          continue;
+        }
 
-          // Check safety
-          Eigen::Vector3d pos, vel;
-          Eigen::Matrix<double, 6, 1> xt;
-          bool is_occ = false;
-          for (int k = 1; k <= check_num_; ++k) {
-            double dt = tau * double(k) / double(check_num_);
-            stateTransit(cur_state, xt, um, dt);
-            pos = xt.head(3);
-            vel = xt.tail(3);
-            // TODO check cur_node->time + dt
-            // if (gridMapPtr_->getInflateOccupancy(pos) == 1) {
-            if (!rayValid(pos, vel, cur_node->time + dt)) {
-              is_occ = true;
-              break;
+        double time_to_goal, tmp_g_score, tmp_f_score;
+        tmp_g_score = prim.cost + cur_node->g_score;
+        tmp_f_score = tmp_g_score +
+                      lambda_heu_ * estimateHeuristic(pro_state, end_state,
+                                                      time_to_goal);
+
+        // Compare nodes expanded from the same parent
+        bool prune = false;
+        for (int j = 0; j < (int)tmp_expand_nodes.size(); ++j) {
+          PathNodePtr expand_node = tmp_expand_nodes[j];
+          if ((pro_id - expand_node->index).norm() == 0 &&
+              ((!dynamic) || pro_t_id == expand_node->time_idx)) {
+            prune = true;
+            if (tmp_f_score < expand_node->f_score) {
+              expand_node->f_score = tmp_f_score;
+              expand_node->g_score = tmp_g_score;
+              expand_node->state = pro_state;
+              expand_node->input = um;
+              expand_node->duration = tau;
+              if (dynamic)
+                expand_node->time = cur_node->time + tau;
             }
+            break;
           }
-          if (is_occ) {
-            if (init_search)
-              std::cout << "safe" << std::endl;
-            continue;
-          }
+        }
 
-          double time_to_goal, tmp_g_score, tmp_f_score;
-          tmp_g_score = (um.squaredNorm() + w_time_) * tau + cur_node->g_score;
-          tmp_f_score = tmp_g_score +
-                        lambda_heu_ * estimateHeuristic(pro_state, end_state,
-                                                        time_to_goal);
-
-          // Compare nodes expanded from the same parent
-          bool prune = false;
-          for (int j = 0; j < (int)tmp_expand_nodes.size(); ++j) {
-            PathNodePtr expand_node = tmp_expand_nodes[j];
-            if ((pro_id - expand_node->index).norm() == 0 &&
-                ((!dynamic) || pro_t_id == expand_node->time_idx)) {
-              prune = true;
-              if (tmp_f_score < expand_node->f_score) {
-                expand_node->f_score = tmp_f_score;
-                expand_node->g_score = tmp_g_score;
-                expand_node->state = pro_state;
-                expand_node->input = um;
-                expand_node->duration = tau;
-                if (dynamic)
-                  expand_node->time = cur_node->time + tau;
-              }
-              break;
+        // This node end up in a voxel different from others
+        if (!prune) {
+          if (pro_node == NULL) {
+            pro_node = path_node_pool_[use_node_num_];
+            pro_node->index = pro_id;
+            pro_node->state = pro_state;
+            pro_node->f_score = tmp_f_score;
+            pro_node->g_score = tmp_g_score;
+            pro_node->input = um;
+            pro_node->duration = tau;
+            pro_node->parent = cur_node;
+            pro_node->node_state = IN_OPEN_SET;
+            if (dynamic) {
+              pro_node->time = cur_node->time + tau;
+              pro_node->time_idx = timeToIndex(pro_node->time);
             }
-          }
+            open_set_.push(pro_node);
+
+            if (dynamic)
+              expanded_nodes_.insert(pro_id, pro_node->time, pro_node);
+            else
+              expanded_nodes_.insert(pro_id, pro_node);
 
-          // This node end up in a voxel different from others
-          if (!prune) {
-            if (pro_node == NULL) {
-              pro_node = path_node_pool_[use_node_num_];
-              pro_node->index = pro_id;
+            tmp_expand_nodes.push_back(pro_node);
+
+            use_node_num_ += 1;
+            if (use_node_num_ == allocate_num_) {
+              cout << "run out of memory." << endl;
+              return NO_PATH;
+            }
+          } else if (pro_node->node_state == IN_OPEN_SET) {
+            if (tmp_g_score < pro_node->g_score) {
+              // pro_node->index = pro_id;
               pro_node->state = pro_state;
               pro_node->f_score = tmp_f_score;
               pro_node->g_score = tmp_g_score;
               pro_node->input = um;
               pro_node->duration = tau;
               pro_node->parent = cur_node;
-              pro_node->node_state = IN_OPEN_SET;
-              if (dynamic) {
-                pro_node->time = cur_node->time + tau;
-                pro_node->time_idx = timeToIndex(pro_node->time);
-              }
-              open_set_.push(pro_node);
-
               if (dynamic)
-                expanded_nodes_.insert(pro_id, pro_node->time, pro_node);
-              else
-                expanded_nodes_.insert(pro_id, pro_node);
-
-              tmp_expand_nodes.push_back(pro_node);
-
-              use_node_num_ += 1;
-              if (use_node_num_ == allocate_num_) {
-                cout << "run out of memory." << endl;
-                return NO_PATH;
-              }
-            } else if (pro_node->node_state == IN_OPEN_SET) {
-              if (tmp_g_score < pro_node->g_score) {
-                // pro_node->index = pro_id;
-                pro_node->state = pro_state;
-                pro_node->f_score = tmp_f_score;
-                pro_node->g_score = tmp_g_score;
-                pro_node->input = um;
-                pro_node->duration = tau;
-                pro_node->parent = cur_node;
-                if (dynamic)
-                  pro_node->time = cur_node->time + tau;
-              }
-            } else {
-              cout << "error type in searching: " << pro_node->node_state
-                   << endl;
+                pro_node->time = cur_node->time + tau;
             }
+          } else {
+            cout << "error type in searching: " << pro_node->node_state
+                 << endl;
           }
         }
+      }
       // init_search = false;
     }
 
@@ -728,62 +728,31 @@ namespace ego_planner
     }
 
     /* ---------- check trajectory ---------- */
-    constexpr double time_step = 0.01;
     double t_cur = (ros::Time::now() - info->start_time_).toSec();
-    Eigen::Vector3d p_cur = info->position_traj_.evaluateDeBoorT(t_cur);
-    const double CLEARANCE = 1.0 * planner_manager_->getSwarmClearance();
-    double t_cur_global = ros::Time::now().toSec();
     double t_2_3 = info->duration_ * 2 / 3;
-    for (double t = t_cur; t < info->duration_; t += time_step)
+    double t_end = t_cur < t_2_3 ? t_2_3 : info->duration_; // If t_cur < t_2_3, only the first 2/3 partition of the trajectory is considered valid and will get checked.
+    double t;
+    if (planner_manager_->sweepTrajCollision(info->position_traj_, info->start_time_, t_cur, t_end, t))
     {
-      if (t_cur < t_2_3 && t >= t_2_3) // If t_cur < t_2_3, only the first 2/3 partition of the trajectory is considered valid and will get checked.
-        break;
-
-      bool occ = false;
-      occ |= map->getInflateOccupancy(info->position_traj_.evaluateDeBoorT(t));
-
-      for (size_t id = 0; id < planner_manager_->swarm_trajs_buf_.size(); id++)
+      if (planFromCurrentTraj()) // Make a chance
       {
-        if ( (planner_manager_->swarm_trajs_buf_.at(id).drone_id != (int)id) || (planner_manager_->swarm_trajs_buf_.at(id).drone_id == planner_manager_->pp_.drone_id) )
-        {
-          continue;
-        }
-
-        double t_X = t_cur_global - planner_manager_->swarm_trajs_buf_.at(id).start_time_.toSec();
-        Eigen::Vector3d swarm_pridicted = planner_manager_->swarm_trajs_buf_.at(id).position_traj_.evaluateDeBoorT(t_X);
-        double dist = (p_cur - swarm_pridicted).norm();
-
-        if ( dist < CLEARANCE )
-        {
-          occ = true;
-          break;
-        }
+        changeFSMExecState(EXEC_TRAJ, "SAFETY");
+        publishSwarmTrajs(false);
+        return;
       }
-
-      if (occ)
+      else
       {
-
-        if (planFromCurrentTraj()) // Make a chance
+        if (t - t_cur < emergency_time_) // 0.8s of emergency time
         {
-          changeFSMExecState(EXEC_TRAJ, "SAFETY");
-          publishSwarmTrajs(false);
-          return;
+          ROS_WARN("Suddenly discovered obstacles. emergency stop! time=%f", t - t_cur);
+          changeFSMExecState(EMERGENCY_STOP, "SAFETY");
         }
         else
         {
-          if (t - t_cur < emergency_time_) // 0.8s of emergency time
-          {
-            ROS_WARN("Suddenly discovered obstacles. emergency stop! time=%f", t - t_cur);
-            changeFSMExecState(EMERGENCY_STOP, "SAFETY");
-          }
-          else
-          {
-            //ROS_WARN("current traj in collision, replan.");
-            changeFSMExecState(REPLAN_TRAJ, "SAFETY");
-          }
-          return;
+          //ROS_WARN("current traj in collision, replan.");
+          changeFSMExecState(REPLAN_TRAJ, "SAFETY");
         }
-        break;
+        return;
       }
     }
   }
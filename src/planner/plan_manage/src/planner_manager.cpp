@@ -23,6 +23,9 @@ namespace ego_planner
     nh.param("manager/control_points_distance", pp_.ctrl_pt_dist, -1.0);
     nh.param("manager/planning_horizon", pp_.planning_horizen_, 5.0);
     nh.param("manager/use_distinctive_trajs", pp_.use_distinctive_trajs, false);
+    nh.param("manager/candidate_threads", pp_.candidate_threads, 1);
+    nh.param("manager/candidate_cost_ratio", pp_.candidate_cost_ratio, 2.0);
+    nh.param("manager/astar_search_mode", pp_.astar_search_mode, 0);
     nh.param("manager/drone_id", pp_.drone_id, -1);
     nh.param("manager/attract_max_dist_threshold", pp_.attract_max_dist_threshold_, 6.0);
     nh.param("manager/attract_min_dist_threshold", pp_.attract_min_dist_threshold_, 6.0);
@@ -41,6 +44,22 @@ namespace ego_planner
     bspline_optimizer_->setEnvironment(grid_map_, obj_predictor_);
     bspline_optimizer_->a_star_.reset(new AStar);
     bspline_optimizer_->a_star_->initGridMap(grid_map_, Eigen::Vector3i(100, 100, 100));
+    bspline_optimizer_->a_star_->setSearchMode(pp_.astar_search_mode);
+
+    if (pp_.use_distinctive_trajs && pp_.candidate_threads > 1)
+    {
+      candidate_pool_.reset(new ThreadPool(pp_.candidate_threads));
+      for (int i = 0; i < pp_.candidate_threads; ++i)
+      {
+        // the rebound step searches with A*, whose node pool can not be shared between threads
+        BsplineOptimizer::Ptr opt(new BsplineOptimizer(bspline_optimizer_->getProblem()));
+        opt->a_star_.reset(new AStar);
+        opt->a_star_->initGridMap(grid_map_, Eigen::Vector3i(100, 100, 100));
+        opt->a_star_->setSearchMode(pp_.astar_search_mode);
+        candidate_optimizers_.push_back(std::move(opt));
+      }
+      cout << "[manager] optimize distinctive trajs with " << pp_.candidate_threads << " threads" << endl;
+    }
 
     visualization_ = vis;
 
@@ -229,7 +248,8 @@ namespace ego_planner
     kino_path_finder_->getSamples(ts, point_set, start_end_derivatives);
 
     Eigen::MatrixXd ctrl_pts;
-    UniformBspline::parameterizeToBspline(ts, point_set, start_end_derivatives, ctrl_pts);
+    if (!UniformBspline::parameterizeToBspline(ts, point_set, start_end_derivatives, ctrl_pts))
+      return false;
     visualization_->displayOptimalList(ctrl_pts, 1);
 
     // bspline init
@@ -412,7 +432,12 @@ namespace ego_planner
     } while (flag_regenerate);
 
     Eigen::MatrixXd ctrl_pts, ctrl_pts_temp;
-    UniformBspline::parameterizeToBspline(ts, point_set, start_end_derivatives, ctrl_pts);
+    if (!UniformBspline::parameterizeToBspline(ts, point_set, start_end_derivatives, ctrl_pts))
+    {
+      ROS_ERROR("Failed to parameterize the initial path, return!");
+      continous_failures_count_++;
+      return false;
+    }
 
     vector<std::pair<int, int>> segments;
     segments = bspline_optimizer_->initControlPoints(ctrl_pts, true);
@@ -431,10 +456,32 @@ namespace ego_planner
       cout << "\033[1;33m"
            << "multi-trajs=" << trajs.size() << "\033[1;0m" << endl;
 
+      const int traj_num = trajs.size();
+      vector<Eigen::MatrixXd> cand_pts;
+      vector<double> cand_cost;
+      vector<char> cand_success;
+
+      vector<BsplineOptimizer *> optimizers;
+      if (candidate_pool_)
+      {
+        for (auto &opt : candidate_optimizers_)
+        {
+          opt->setProblem(bspline_optimizer_->getProblem()); // current swarm, target and weights
+          optimizers.push_back(opt.get());
+        }
+      }
+      else
+        optimizers.push_back(bspline_optimizer_.get());
+      BsplineOptimizer::optimizeCandidates(optimizers, candidate_pool_.get(), trajs, ts, pp_.candidate_cost_ratio,
+                                           cand_pts, cand_cost, cand_success);
+
+      // reduce in a fixed order so ties always pick the same trajectory
       double final_cost, min_cost = 999999.0;
-      for (int i = trajs.size() - 1; i >= 0; i--)
+      for (int i = traj_num - 1; i >= 0; i--)
       {
-        if (bspline_optimizer_->BsplineOptimizeTrajRebound(ctrl_pts_temp, final_cost, trajs[i], ts))
+        ctrl_pts_temp = cand_pts[i];
+        final_cost = cand_cost[i];
+        if (cand_success[i])
         {
 
           cout << "traj " << trajs.size() - i << " success." << endl;
@@ -572,6 +619,83 @@ namespace ego_planner
     return false;
   }
 
+  bool EGOPlannerManager::sweepTrajCollision(UniformBspline &traj, const ros::Time &traj_start_time, double t_start, double t_end, double &t_collide)
+  {
+    const int p = traj.getOrder();
+    const Eigen::MatrixXd cps = traj.getControlPoint();
+    const Eigen::VectorXd u = traj.getKnot();
+    const double res = grid_map_->getResolution();
+
+    t_collide = t_end;
+    bool collide = false;
+
+    // the fixed-degree evaluator is only instantiated for cubic splines
+    auto position = [](UniformBspline &bs, double t) -> Eigen::Vector3d {
+      return bs.getOrder() == 3 ? bs.evaluateFixedT<3, 3>(t) : Eigen::Vector3d(bs.evaluateDeBoorT(t));
+    };
+
+    /* ---------- map: a span lies in the convex hull of its p+1 control points ---------- */
+    for (int k = p; k < cps.cols(); ++k)
+    {
+      double span_t0 = u(k) - u(p), span_t1 = u(k + 1) - u(p);
+      if (span_t1 <= t_start)
+        continue;
+      if (span_t0 >= t_end)
+        break;
+
+      Eigen::MatrixXd::ConstColsBlockXpr hull = cps.middleCols(k - p, p + 1);
+      Eigen::Vector3d center = hull.rowwise().mean();
+      double radius = (hull.colwise() - center).colwise().norm().maxCoeff();
+      if (grid_map_->isBallFree(center, radius))
+        continue;
+
+      // without a usable ESDF, the bounding box of the hull is tested column by column on the bitset
+      if (grid_map_->isBoxFree(hull.rowwise().minCoeff(), hull.rowwise().maxCoeff()))
+        continue;
+
+      // clearance is tight, sample so that consecutive samples are at most half a voxel apart
+      double max_vel = 1e-3;
+      for (int i = k - p; i < k; ++i)
+        max_vel = max(max_vel, p * (cps.col(i + 1) - cps.col(i)).norm() / (u(i + p + 1) - u(i + 1)));
+      double dt = 0.5 * res / max_vel;
+
+      for (double t = max(t_start, span_t0); t < min(t_end, span_t1); t += dt)
+      {
+        if (grid_map_->getInflateOccupancy(position(traj, t)) != 0)
+        {
+          t_collide = t;
+          collide = true;
+          break;
+        }
+      }
+      if (collide)
+        break;
+    }
+
+    /* ---------- swarm: separation at the same moment, only before the map collision ---------- */
+    constexpr double time_step = 0.01;
+    const double clearance = bspline_optimizer_->getSwarmClearance();
+    for (size_t id = 0; id < swarm_trajs_buf_.size(); id++)
+    {
+      if ((swarm_trajs_buf_.at(id).drone_id != (int)id) || (swarm_trajs_buf_.at(id).drone_id == pp_.drone_id))
+        continue;
+
+      double t_offset = (traj_start_time - swarm_trajs_buf_.at(id).start_time_).toSec();
+      for (double t = t_start; t < t_collide; t += time_step)
+      {
+        Eigen::Vector3d swarm_pos = position(swarm_trajs_buf_.at(id).position_traj_, t + t_offset);
+        if ((position(traj, t) - swarm_pos).norm() < clearance)
+        {
+          t_collide = t;
+          collide = true;
+          break;
+        }
+      }
+    }
+
+    return collide;
+  }
+
   bool EGOPlannerManager::planGlobalTrajWaypoints(const Eigen::Vector3d &start_pos, const Eigen::Vector3d &start_vel, const Eigen::Vector3d &start_acc,
                                                   const std::vector<Eigen::Vector3d> &waypoints, const Eigen::Vector3d &end_vel, const Eigen::Vector3d &end_acc)
   {
@@ -723,7 +847,8 @@ namespace ego_planner
     Eigen::MatrixXd ctrl_pts; // = traj.getControlPoint()
 
     // std::cout << "ratio: " << ratio << std::endl;
-    reparamBspline(traj, start_end_derivative, ratio, ctrl_pts, ts, t_inc);
+    if (!reparamBspline(traj, start_end_derivative, ratio, ctrl_pts, ts, t_inc))
+      return false;
 
     traj = UniformBspline(ctrl_pts, 3, ts);
 
@@ -756,7 +881,7 @@ namespace ego_planner
     // local_data_.start_yaw_ = local_data_.yaw_traj.evaluateDeBoorT(0.0);
   }
 
-  void EGOPlannerManager::reparamBspline(UniformBspline &bspline, vector<Eigen::Vector3d> &start_end_derivative, double ratio,
+  bool EGOPlannerManager::reparamBspline(UniformBspline &bspline, vector<Eigen::Vector3d> &start_end_derivative, double ratio,
                                          Eigen::MatrixXd &ctrl_pts, double &dt, double &time_inc)
   {
     double time_origin = bspline.getTimeSum();
@@ -774,7 +899,7 @@ namespace ego_planner
     {
       point_set.push_back(bspline.evaluateDeBoorT(time));
     }
-    UniformBspline::parameterizeToBspline(dt, point_set, start_end_derivative, ctrl_pts);
+    return UniformBspline::parameterizeToBspline(dt, point_set, start_end_derivative, ctrl_pts);
   }
 
 } // namespace ego_planner
@@ -282,7 +282,7 @@ std::pair<double, double> calculate_yaw(double t_cur, Eigen::Vector3d &pos, ros:
   double yaw = 0;
   double yawdot = 0;
 
-  Eigen::Vector3d dir = t_cur + time_forward_ <= traj_duration_ ? traj_[0].evaluateDeBoorT(t_cur + time_forward_) - pos : traj_[0].evaluateDeBoorT(traj_duration_) - pos;
+  Eigen::Vector3d dir = traj_[0].evaluateFixedT<3, 3>(min(t_cur + time_forward_, traj_duration_)) - pos;
   double yaw_temp = dir.norm() > 0.1 ? atan2(dir(1), dir(0)) : last_yaw_;
   double max_yaw_change = YAW_DOT_MAX_PER_SEC * (time_now - time_last).toSec();
   if (yaw_temp - last_yaw_ > PI)
@@ -380,9 +380,7 @@ void cmdCallback(const ros::TimerEvent &e)
   static ros::Time time_last = ros::Time::now();
   if (t_cur < traj_duration_ && t_cur >= 0.0)
   {
-    pos = traj_[0].evaluateDeBoorT(t_cur);
-    vel = traj_[1].evaluateDeBoorT(t_cur);
-    acc = traj_[2].evaluateDeBoorT(t_cur);
+    traj_[0].evaluateFixedT<3, 3>(t_cur, pos, vel, acc);
 
     /*** calculate yaw zx***/
     if( !have_yaw_ )
@@ -395,7 +393,7 @@ void cmdCallback(const ros::TimerEvent &e)
     }
     
     double tf = min(traj_duration_, t_cur + 2.0);
-    pos_f = traj_[0].evaluateDeBoorT(tf);
+    pos_f = traj_[0].evaluateFixedT<3, 3>(tf);
   }
   else if (t_cur >= traj_duration_)
   {
@@ -0,0 +1,83 @@
+#ifndef _BANDED_CHOLESKY_H_
+#define _BANDED_CHOLESKY_H_
+
+#include <Eigen/Eigen>
+#include <algorithm>
+#include <cmath>
+
+// Cholesky factorization A = L * L^T of a symmetric positive definite band matrix.
+// Only the lower band of half width p is stored, column j of band_ holds A(j..j+p, j),
+// so factorization costs O(n p^2) and each solve O(n p) per right hand side.
+class BandedCholesky
+{
+public:
+  BandedCholesky(int n, int p) : n_(n), p_(p), band_(Eigen::MatrixXd::Zero(p + 1, n)) {}
+
+  int size() const { return n_; }
+
+  // A(i, j) with j <= i <= j + p
+  double &operator()(int i, int j) { return band_(i - j, j); }
+  double operator()(int i, int j) const { return band_(i - j, j); }
+
+  // the full symmetric matrix, A before factorize() and L + L^T - diag(L) after it
+  Eigen::MatrixXd toDense() const
+  {
+    Eigen::MatrixXd a = Eigen::MatrixXd::Zero(n_, n_);
+    for (int j = 0; j < n_; ++j)
+      for (int i = j; i <= std::min(n_ - 1, j + p_); ++i)
+        a(i, j) = a(j, i) = (*this)(i, j);
+    return a;
+  }
+
+  // in place, false if A is not positive definite
+  bool factorize()
+  {
+    for (int j = 0; j < n_; ++j)
+    {
+      int k0 = std::max(0, j - p_);
+
+      double d = (*this)(j, j);
+      for (int k = k0; k < j; ++k)
+        d -= (*this)(j, k) * (*this)(j, k);
+      if (!(d > 0.0))
+        return false;
+      d = std::sqrt(d);
+      (*this)(j, j) = d;
+
+      int i_end = std::min(n_ - 1, j + p_);
+      for (int i = j + 1; i <= i_end; ++i)
+      {
+        double s = (*this)(i, j);
+        for (int k = std::max(0, i - p_); k < j; ++k)
+          s -= (*this)(i, k) * (*this)(j, k);
+        (*this)(i, j) = s / d;
+      }
+    }
+    return true;
+  }
+
+  // solve A * X = B in place for all columns of B at once, must be called after factorize()
+  template <typename Derived>
+  void solveInPlace(Eigen::MatrixBase<Derived> &b) const
+  {
+    for (int i = 0; i < n_; ++i)
+    {
+      for (int k = std::max(0, i - p_); k < i; ++k)
+        b.row(i) -= (*this)(i, k) * b.row(k);
+      b.row(i) /= (*this)(i, i);
+    }
+    for (int i = n_ - 1; i >= 0; --i)
+    {
+      int k_end = std::min(n_ - 1, i + p_);
+      for (int k = i + 1; k <= k_end; ++k)
+        b.row(i) -= (*this)(k, i) * b.row(k);
+      b.row(i) /= (*this)(i, i);
+    }
+  }
+
+private:
+  int n_, p_;
+  Eigen::MatrixXd band_;
+};
+
+#endif
@@ -196,6 +196,9 @@ namespace ego_planner
     double feasibility_tolerance_;        // permitted ratio of vel/acc exceeding limits
     double planning_horizen_;
     bool use_distinctive_trajs;
+    int candidate_threads;        // threads optimizing the distinctive candidates, <= 1 runs them serially
+    double candidate_cost_ratio;  // candidates stop once their cost exceeds ratio * best finished cost, <= 0 disables
+    int astar_search_mode;        // collision segment A*: 0 26-connected, 1 jump point search, 2 bidirectional
     int drone_id; // single drone: drone_id <= -1, swarm: drone_id >= 0
 
     /* processing time */
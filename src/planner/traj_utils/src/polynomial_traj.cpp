@@ -1,5 +1,6 @@
 #include <iostream>
 #include <traj_utils/polynomial_traj.h>
+#include <traj_utils/banded_cholesky.h>
 
 PolynomialTraj PolynomialTraj::minSnapTraj(const Eigen::MatrixXd &Pos, const Eigen::Vector3d &start_vel,
                                            const Eigen::Vector3d &end_vel, const Eigen::Vector3d &start_acc,
@@ -7,7 +8,6 @@ PolynomialTraj PolynomialTraj::minSnapTraj(const Eigen::MatrixXd &Pos, const Eig
 {
   int seg_num = Time.size();
   Eigen::MatrixXd poly_coeff(seg_num, 3 * 6);
-  Eigen::VectorXd Px(6 * seg_num), Py(6 * seg_num), Pz(6 * seg_num);
 
   int num_f, num_p; // number of fixed and free variables
   int num_d;        // number of all segments' derivatives
@@ -19,150 +19,132 @@ PolynomialTraj PolynomialTraj::minSnapTraj(const Eigen::MatrixXd &Pos, const Eig
     return fac;
   };
 
-  /* ---------- end point derivative ---------- */
-  Eigen::VectorXd Dx = Eigen::VectorXd::Zero(seg_num * 6);
-  Eigen::VectorXd Dy = Eigen::VectorXd::Zero(seg_num * 6);
-  Eigen::VectorXd Dz = Eigen::VectorXd::Zero(seg_num * 6);
+  num_f = 2 * seg_num + 4; // 3 + 3 + (seg_num - 1) * 2 = 2m + 4
+  num_p = 2 * seg_num - 2; //(seg_num - 1) * 2 = 2m - 2
+  num_d = 6 * seg_num;
+
+  /* ---------- end point derivative, one column per axis ---------- */
+  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(num_d, 3);
 
   for (int k = 0; k < seg_num; k++)
   {
     /* position to derivative */
-    Dx(k * 6) = Pos(0, k);
-    Dx(k * 6 + 1) = Pos(0, k + 1);
-    Dy(k * 6) = Pos(1, k);
-    Dy(k * 6 + 1) = Pos(1, k + 1);
-    Dz(k * 6) = Pos(2, k);
-    Dz(k * 6 + 1) = Pos(2, k + 1);
+    D.row(k * 6) = Pos.col(k).transpose();
+    D.row(k * 6 + 1) = Pos.col(k + 1).transpose();
 
     if (k == 0)
     {
-      Dx(k * 6 + 2) = start_vel(0);
-      Dy(k * 6 + 2) = start_vel(1);
-      Dz(k * 6 + 2) = start_vel(2);
-
-      Dx(k * 6 + 4) = start_acc(0);
-      Dy(k * 6 + 4) = start_acc(1);
-      Dz(k * 6 + 4) = start_acc(2);
+      D.row(k * 6 + 2) = start_vel.transpose();
+      D.row(k * 6 + 4) = start_acc.transpose();
     }
     else if (k == seg_num - 1)
     {
-      Dx(k * 6 + 3) = end_vel(0);
-      Dy(k * 6 + 3) = end_vel(1);
-      Dz(k * 6 + 3) = end_vel(2);
-
-      Dx(k * 6 + 5) = end_acc(0);
-      Dy(k * 6 + 5) = end_acc(1);
-      Dz(k * 6 + 5) = end_acc(2);
+      D.row(k * 6 + 3) = end_vel.transpose();
+      D.row(k * 6 + 5) = end_acc.transpose();
     }
   }
 
-  /* ---------- Mapping Matrix A ---------- */
-  Eigen::MatrixXd Ab;
-  Eigen::MatrixXd A = Eigen::MatrixXd::Zero(seg_num * 6, seg_num * 6);
+  /* ---------- Selection C', sel[i] is the variable of derivative i ---------- */
+  // C' has a single 1 per row, so it is kept as an index map instead of a dense matrix
+  Eigen::VectorXi sel(num_d);
+  sel(0) = 0;
+  sel(2) = 1;
+  sel(4) = 2; // stack the start point
+  sel(1) = 3;
+  sel(3) = 2 * seg_num + 4;
+  sel(5) = 2 * seg_num + 5;
+
+  sel(6 * (seg_num - 1) + 0) = 2 * seg_num + 0;
+  sel(6 * (seg_num - 1) + 1) = 2 * seg_num + 1; // Stack the end point
+  sel(6 * (seg_num - 1) + 2) = 4 * seg_num + 0;
+  sel(6 * (seg_num - 1) + 3) = 2 * seg_num + 2; // Stack the end point
+  sel(6 * (seg_num - 1) + 4) = 4 * seg_num + 1;
+  sel(6 * (seg_num - 1) + 5) = 2 * seg_num + 3; // Stack the end point
+
+  for (int j = 2; j < seg_num; j++)
+  {
+    sel(6 * (j - 1) + 0) = 2 + 2 * (j - 1) + 0;
+    sel(6 * (j - 1) + 1) = 2 + 2 * (j - 1) + 1;
+    sel(6 * (j - 1) + 2) = 2 * seg_num + 4 + 2 * (j - 2) + 0;
+    sel(6 * (j - 1) + 3) = 2 * seg_num + 4 + 2 * (j - 1) + 0;
+    sel(6 * (j - 1) + 4) = 2 * seg_num + 4 + 2 * (j - 2) + 1;
+    sel(6 * (j - 1) + 5) = 2 * seg_num + 4 + 2 * (j - 1) + 1;
+  }
+
+  Eigen::MatrixXd D1 = Eigen::MatrixXd::Zero(num_f + num_p, 3); // C * D
+  for (int i = 0; i < num_d; i++)
+    D1.row(sel(i)) = D.row(i);
+
+  /* ---------- Mapping Matrix A and minimum snap matrix Q, both block diagonal ---------- */
+  // R = C * A^-T * Q * A^-1 * C' is assembled from the 6x6 blocks of A^-T * Q * A^-1.
+  // A segment only couples the free derivatives of its two ends, so Rpp has half bandwidth 3.
+  std::vector<Eigen::Matrix<double, 6, 6>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 6>>> A_inv(seg_num);
+  BandedCholesky Rpp(num_p, 3);
+  Eigen::MatrixXd Rpf_Df = Eigen::MatrixXd::Zero(num_p, 3);
 
   for (int k = 0; k < seg_num; k++)
   {
-    Ab = Eigen::MatrixXd::Zero(6, 6);
+    Eigen::Matrix<double, 6, 6> Ab = Eigen::Matrix<double, 6, 6>::Zero();
     for (int i = 0; i < 3; i++)
     {
       Ab(2 * i, i) = Factorial(i);
       for (int j = i; j < 6; j++)
         Ab(2 * i + 1, j) = Factorial(j) / Factorial(j - i) * pow(Time(k), j - i);
     }
-    A.block(k * 6, k * 6, 6, 6) = Ab;
-  }
-
-  /* ---------- Produce Selection Matrix C' ---------- */
-  Eigen::MatrixXd Ct, C;
-
-  num_f = 2 * seg_num + 4; // 3 + 3 + (seg_num - 1) * 2 = 2m + 4
-  num_p = 2 * seg_num - 2; //(seg_num - 1) * 2 = 2m - 2
-  num_d = 6 * seg_num;
-  Ct = Eigen::MatrixXd::Zero(num_d, num_f + num_p);
-  Ct(0, 0) = 1;
-  Ct(2, 1) = 1;
-  Ct(4, 2) = 1; // stack the start point
-  Ct(1, 3) = 1;
-  Ct(3, 2 * seg_num + 4) = 1;
-  Ct(5, 2 * seg_num + 5) = 1;
-
-  Ct(6 * (seg_num - 1) + 0, 2 * seg_num + 0) = 1;
-  Ct(6 * (seg_num - 1) + 1, 2 * seg_num + 1) = 1; // Stack the end point
-  Ct(6 * (seg_num - 1) + 2, 4 * seg_num + 0) = 1;
-  Ct(6 * (seg_num - 1) + 3, 2 * seg_num + 2) = 1; // Stack the end point
-  Ct(6 * (seg_num - 1) + 4, 4 * seg_num + 1) = 1;
-  Ct(6 * (seg_num - 1) + 5, 2 * seg_num + 3) = 1; // Stack the end point
-
-  for (int j = 2; j < seg_num; j++)
-  {
-    Ct(6 * (j - 1) + 0, 2 + 2 * (j - 1) + 0) = 1;
-    Ct(6 * (j - 1) + 1, 2 + 2 * (j - 1) + 1) = 1;
-    Ct(6 * (j - 1) + 2, 2 * seg_num + 4 + 2 * (j - 2) + 0) = 1;
-    Ct(6 * (j - 1) + 3, 2 * seg_num + 4 + 2 * (j - 1) + 0) = 1;
-    Ct(6 * (j - 1) + 4, 2 * seg_num + 4 + 2 * (j - 2) + 1) = 1;
-    Ct(6 * (j - 1) + 5, 2 * seg_num + 4 + 2 * (j - 1) + 1) = 1;
-  }
-
-  C = Ct.transpose();
-
-  Eigen::VectorXd Dx1 = C * Dx;
-  Eigen::VectorXd Dy1 = C * Dy;
-  Eigen::VectorXd Dz1 = C * Dz;
-
-  /* ---------- minimum snap matrix ---------- */
-  Eigen::MatrixXd Q = Eigen::MatrixXd::Zero(seg_num * 6, seg_num * 6);
+    A_inv[k] = Ab.inverse();
 
-  for (int k = 0; k < seg_num; k++)
-  {
+    Eigen::Matrix<double, 6, 6> Q = Eigen::Matrix<double, 6, 6>::Zero();
     for (int i = 3; i < 6; i++)
     {
       for (int j = 3; j < 6; j++)
       {
-        Q(k * 6 + i, k * 6 + j) =
-            i * (i - 1) * (i - 2) * j * (j - 1) * (j - 2) / (i + j - 5) * pow(Time(k), (i + j - 5));
+        Q(i, j) = i * (i - 1) * (i - 2) * j * (j - 1) * (j - 2) / (i + j - 5) * pow(Time(k), (i + j - 5));
       }
     }
-  }
-
-  /* ---------- R matrix ---------- */
-  Eigen::MatrixXd R = C * A.transpose().inverse() * Q * A.inverse() * Ct;
-
-  Eigen::VectorXd Dxf(2 * seg_num + 4), Dyf(2 * seg_num + 4), Dzf(2 * seg_num + 4);
-
-  Dxf = Dx1.segment(0, 2 * seg_num + 4);
-  Dyf = Dy1.segment(0, 2 * seg_num + 4);
-  Dzf = Dz1.segment(0, 2 * seg_num + 4);
 
-  Eigen::MatrixXd Rff(2 * seg_num + 4, 2 * seg_num + 4);
-  Eigen::MatrixXd Rfp(2 * seg_num + 4, 2 * seg_num - 2);
-  Eigen::MatrixXd Rpf(2 * seg_num - 2, 2 * seg_num + 4);
-  Eigen::MatrixXd Rpp(2 * seg_num - 2, 2 * seg_num - 2);
-
-  Rff = R.block(0, 0, 2 * seg_num + 4, 2 * seg_num + 4);
-  Rfp = R.block(0, 2 * seg_num + 4, 2 * seg_num + 4, 2 * seg_num - 2);
-  Rpf = R.block(2 * seg_num + 4, 0, 2 * seg_num - 2, 2 * seg_num + 4);
-  Rpp = R.block(2 * seg_num + 4, 2 * seg_num + 4, 2 * seg_num - 2, 2 * seg_num - 2);
+    Eigen::Matrix<double, 6, 6> Rk = A_inv[k].transpose() * Q * A_inv[k];
+    for (int a = 0; a < 6; a++)
+    {
+      int p = sel(k * 6 + a) - num_f;
+      if (p < 0)
+        continue;
+      for (int b = 0; b < 6; b++)
+      {
+        int q = sel(k * 6 + b) - num_f;
+        if (q < 0)
+          Rpf_Df.row(p) += Rk(a, b) * D1.row(num_f + q);
+        else if (q <= p)
+          Rpp(p, q) += Rk(a, b);
+      }
+    }
+  }
 
   /* ---------- close form solution ---------- */
+  // Dp = -Rpp^-1 * Rfp' * Df
+  if (num_p > 0)
+  {
+    const BandedCholesky Rpp_band = Rpp; // factorize() overwrites Rpp even when it fails
+    if (Rpp.factorize())
+    {
+      Rpp.solveInPlace(Rpf_Df);
+    }
+    else
+    {
+      std::cout << "[minSnapTraj]: Rpp is not positive definite, solve it dense." << std::endl;
+      Rpf_Df = Rpp_band.toDense().ldlt().solve(Rpf_Df);
+    }
+    D1.bottomRows(num_p) = -Rpf_Df;
+  }
 
-  Eigen::VectorXd Dxp(2 * seg_num - 2), Dyp(2 * seg_num - 2), Dzp(2 * seg_num - 2);
-  Dxp = -(Rpp.inverse() * Rfp.transpose()) * Dxf;
-  Dyp = -(Rpp.inverse() * Rfp.transpose()) * Dyf;
-  Dzp = -(Rpp.inverse() * Rfp.transpose()) * Dzf;
-
-  Dx1.segment(2 * seg_num + 4, 2 * seg_num - 2) = Dxp;
-  Dy1.segment(2 * seg_num + 4, 2 * seg_num - 2) = Dyp;
-  Dz1.segment(2 * seg_num + 4, 2 * seg_num - 2) = Dzp;
-
-  Px = (A.inverse() * Ct) * Dx1;
-  Py = (A.inverse() * Ct) * Dy1;
-  Pz = (A.inverse() * Ct) * Dz1;
-
-  for (int i = 0; i < seg_num; i++)
+  for (int k = 0; k < seg_num; k++)
   {
-    poly_coeff.block(i, 0, 1, 6) = Px.segment(i * 6, 6).transpose();
-    poly_coeff.block(i, 6, 1, 6) = Py.segment(i * 6, 6).transpose();
-    poly_coeff.block(i, 12, 1, 6) = Pz.segment(i * 6, 6).transpose();
+    Eigen::Matrix<double, 6, 3> Dk;
+    for (int i = 0; i < 6; i++)
+      Dk.row(i) = D1.row(sel(k * 6 + i));
+    Eigen::Matrix<double, 6, 3> Pk = A_inv[k] * Dk;
+
+    for (int i = 0; i < 3; i++)
+      poly_coeff.block(k, 6 * i, 1, 6) = Pk.col(i).transpose();
   }
 
   /* ---------- use polynomials ---------- */
@@ -189,7 +171,7 @@ PolynomialTraj PolynomialTraj::one_segment_traj_gen(const Eigen::Vector3d &start
                                                     double t)
 {
   Eigen::MatrixXd C = Eigen::MatrixXd::Zero(6, 6), Crow(1, 6);
-  Eigen::VectorXd Bx(6), By(6), Bz(6);
+  Eigen::MatrixXd B(6, 3);
 
   C(0, 5) = 1;
   C(1, 4) = 1;
@@ -201,20 +183,17 @@ PolynomialTraj PolynomialTraj::one_segment_traj_gen(const Eigen::Vector3d &start
   Crow << 20 * pow(t, 3), 12 * pow(t, 2), 6 * t, 2, 0, 0;
   C.row(5) = Crow;
 
-  Bx << start_pt(0), start_vel(0), start_acc(0), end_pt(0), end_vel(0), end_acc(0);
-  By << start_pt(1), start_vel(1), start_acc(1), end_pt(1), end_vel(1), end_acc(1);
-  Bz << start_pt(2), start_vel(2), start_acc(2), end_pt(2), end_vel(2), end_acc(2);
+  B << start_pt.transpose(), start_vel.transpose(), start_acc.transpose(), end_pt.transpose(), end_vel.transpose(), end_acc.transpose();
 
-  Eigen::VectorXd Cofx = C.colPivHouseholderQr().solve(Bx);
-  Eigen::VectorXd Cofy = C.colPivHouseholderQr().solve(By);
-  Eigen::VectorXd Cofz = C.colPivHouseholderQr().solve(Bz);
+  // one factorization for all three axes
+  Eigen::MatrixXd Cof = C.colPivHouseholderQr().solve(B);
 
   vector<double> cx(6), cy(6), cz(6);
   for (int i = 0; i < 6; i++)
   {
-    cx[i] = Cofx(i);
-    cy[i] = Cofy(i);
-    cz[i] = Cofz(i);
+    cx[i] = Cof(i, 0);
+    cy[i] = Cof(i, 1);
+    cz[i] = Cof(i, 2);
   }
 
   PolynomialTraj poly_traj;